@@ -1,13 +1,14 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a hash table of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
 //
 // Interface:
 // * To get a buffer for a particular disk block, call bread.
-// * After changing buffer data, call bwrite to write it to disk.
+// * After changing buffer data, call bwrite to write it to disk
+//     (or bwritev for several buffers).
 // * When done with the buffer, call brelse.
 // * Do not use the buffer after calling brelse.
 // * Only one process at a time can use a buffer,
@@ -19,40 +20,164 @@
 // * B_VALID: the buffer data has been read from the disk.
 // * B_DIRTY: the buffer data has been modified
 //     and needs to be written to disk.
+//
+// The cache is sized at mount (when the block size is known, see fsinit)
+// to 1/BCACHE_SHARE of the physical memory.
+// Buffers are hashed by (dev, sector) into bcache.hash. The hash chains
+// are protected by NHLOCK striped locks, so lookups of different blocks
+// do not contend with each other. All the buffers are also linked into
+// a LRU list (protected by bcache.lock), which is only used to find a
+// victim when a block is not cached. Lock order: bcache.lock, then the
+// bucket locks (at most two, one for the new block and one for the victim).
 
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "arm.h"
 #include "spinlock.h"
+#include "fs.h"
 #include "buf.h"
 
+#define NHLOCK  16      // number of locks for the hash buckets
+#define NREADA  16      // read-ahead buffers queued at once
+#define NOSECT  ((uint)-1)
+
+struct bstripe {
+    struct spinlock lock;
+    uint    hits;       // block found in the cache
+    uint    misses;     // block not in the cache
+    uint    evicts;     // a valid block was recycled for a miss
+    uint    sleeps;     // had to sleep for a busy buffer
+};
+
 struct {
     struct spinlock lock;
-    struct buf buf[NBUF];
+    struct bstripe  stripes[NHLOCK];
+
+    struct buf**    hash;   // hash chains through hnext
+    uint            nhash;  // number of hash buckets (power of 2)
+    int             nbuf;
+    int             nwait;  // sleeping in bget for a free buffer
+    uint            nfull;  // times bget found no buffer to recycle
 
     // Linked list of all buffers, through prev/next.
     // head.next is most recently used.
     struct buf head;
 } bcache;
 
+static inline uint bhash (uint dev, uint sector)
+{
+    return (sector + dev * 31) & (bcache.nhash - 1);
+}
+
+static inline struct bstripe* bstripe (uint h)
+{
+    return &bcache.stripes[h % NHLOCK];
+}
+
 void binit (void)
 {
     struct buf *b;
+    char *hdr, *data;
+    int i, nhdr, ndata;
 
     initlock(&bcache.lock, "bcache");
 
+    for (i = 0; i < NHLOCK; i++) {
+        initlock(&bcache.stripes[i].lock, "bcache.bucket");
+    }
+
+    // size the cache from the available memory, each buffer needs
+    // BSIZE bytes of data plus its header
+    bcache.nbuf = (PHYSTOP - INIT_KERNMAP) / BCACHE_SHARE / (BSIZE + sizeof(*b));
+    bcache.nbuf = UMAX(bcache.nbuf, NBUF_MIN);
+
+    // the hash table takes one page, aim for chains of 2 to 4 buffers
+    bcache.nhash = PTE_SZ / sizeof(struct buf*);
+
+    while ((bcache.nhash > 1) && (bcache.nhash > bcache.nbuf / 2)) {
+        bcache.nhash >>= 1;
+    }
+
+    if ((bcache.hash = alloc_page()) == NULL) {
+        panic("binit: no memory for hash");
+    }
+
+    memset(bcache.hash, 0, PTE_SZ);
+
     //PAGEBREAK!
-    // Create linked list of buffers
+    // Create linked list of buffers. Headers and data blocks are carved
+    // out of separate pages to avoid wasting memory on alignment.
     bcache.head.prev = &bcache.head;
     bcache.head.next = &bcache.head;
 
-    for (b = bcache.buf; b < bcache.buf + NBUF; b++) {
+    nhdr = ndata = 0;
+    hdr = data = NULL;
+
+    for (i = 0; i < bcache.nbuf; i++) {
+        if (nhdr == 0) {
+            hdr = alloc_page();
+            nhdr = PTE_SZ / sizeof(*b);
+        }
+
+        if (ndata == 0) {
+            data = alloc_page();
+            ndata = PTE_SZ / BSIZE;
+        }
+
+        if ((hdr == NULL) || (data == NULL)) {
+            panic("binit: no memory for buffers");
+        }
+
+        b = (struct buf*) hdr;
+        memset(b, 0, sizeof(*b));
+
+        b->data = (uchar*) data;
+        b->dev = -1;
+        b->sector = NOSECT;
         b->next = bcache.head.next;
         b->prev = &bcache.head;
-        b->dev = -1;
         bcache.head.next->prev = b;
         bcache.head.next = b;
+
+        hdr += sizeof(*b);
+        data += BSIZE;
+        nhdr--;
+        ndata--;
+    }
+}
+
+// find the buffer for (dev, sector) in hash chain h. Caller holds the lock.
+static struct buf* bfind (uint h, uint dev, uint sector)
+{
+    struct buf *b;
+
+    for (b = bcache.hash[h]; b != NULL; b = b->hnext) {
+        if (b->dev == dev && b->sector == sector) {
+            return b;
+        }
+    }
+
+    return NULL;
+}
+
+// remove b from its hash chain. Caller holds the lock of the chain.
+static void bunhash (struct buf *b)
+{
+    struct buf **pp;
+
+    pp = &bcache.hash[bhash(b->dev, b->sector)];
+
+    for (; *pp != NULL; pp = &(*pp)->hnext) {
+        if (*pp == b) {
+            *pp = b->hnext;
+            break;
+        }
     }
+
+    b->hnext = NULL;
 }
 
 // Look through buffer cache for sector on device dev.
@@ -61,36 +186,92 @@ void binit (void)
 static struct buf* bget (uint dev, uint sector)
 {
     struct buf *b;
+    struct bstripe *st, *vst;
+    uint h;
 
-    acquire(&bcache.lock);
+    h = bhash(dev, sector);
+    st = bstripe(h);
+
+    acquire(&st->lock);
 
     loop:
     // Is the sector already cached?
-    for (b = bcache.head.next; b != &bcache.head; b = b->next) {
-        if (b->dev == dev && b->sector == sector) {
-            if (!(b->flags & B_BUSY)) {
-                b->flags |= B_BUSY;
-                release(&bcache.lock);
-                return b;
-            }
-
-            sleep(b, &bcache.lock);
-            goto loop;
+    if ((b = bfind(h, dev, sector)) != NULL) {
+        if (!(b->flags & B_BUSY)) {
+            b->flags |= B_BUSY;
+            st->hits++;
+            release(&st->lock);
+            return b;
         }
+
+        st->sleeps++;
+        sleep(b, &st->lock);
+        goto loop;
+    }
+
+    release(&st->lock);
+
+    // Not cached; recycle some non-busy and clean buffer. bcache.lock
+    // serializes the recycling, so we must check the chain again after
+    // taking it (another process might have brought the block in).
+    acquire(&bcache.lock);
+    acquire(&st->lock);
+
+    if (bfind(h, dev, sector) != NULL) {
+        release(&bcache.lock);
+        goto loop;
     }
 
-    // Not cached; recycle some non-busy and clean buffer.
     for (b = bcache.head.prev; b != &bcache.head; b = b->prev) {
-        if ((b->flags & B_BUSY) == 0 && (b->flags & B_DIRTY) == 0) {
+        vst = (b->sector == NOSECT) ? st : bstripe(bhash(b->dev, b->sector));
+
+        if (vst != st) {
+            acquire(&vst->lock);
+        }
+
+        if ((b->flags & (B_BUSY | B_DIRTY)) == 0) {
+            if (b->sector != NOSECT) {
+                bunhash(b);
+
+                if (b->flags & B_VALID) {
+                    st->evicts++;
+                }
+            }
+
+            if (vst != st) {
+                release(&vst->lock);
+            }
+
             b->dev = dev;
             b->sector = sector;
             b->flags = B_BUSY;
+            b->hnext = bcache.hash[h];
+            bcache.hash[h] = b;
+
+            st->misses++;
+            release(&st->lock);
             release(&bcache.lock);
             return b;
         }
+
+        if (vst != st) {
+            release(&vst->lock);
+        }
     }
 
-    panic("bget: no buffers");
+    // All the buffers are busy, or dirty until the log installs them.
+    // Wait for brelse to put one back, then look again from the start,
+    // the block might have been brought in meanwhile.
+    release(&st->lock);
+
+    bcache.nfull++;
+    bcache.nwait++;
+    sleep(&bcache, &bcache.lock);
+    bcache.nwait--;
+
+    release(&bcache.lock);
+    acquire(&st->lock);
+    goto loop;
 }
 
 // Return a B_BUSY buf with the contents of the indicated disk sector.
@@ -107,6 +288,53 @@ struct buf* bread (uint dev, uint sector)
     return b;
 }
 
+// Start reading the blocks in sectors[0..n-1] that are not cached,
+// without waiting for them. The disk driver releases the buffers when
+// the reads complete.
+void breada (uint dev, uint *sectors, int n)
+{
+    struct buf *bufs[NREADA];
+    struct bstripe *st;
+    struct buf *b;
+    uint h;
+    int i, nb;
+
+    nb = 0;
+
+    for (i = 0; i < n; i++) {
+        // skip the cached blocks, we would rather not wait for them
+        h = bhash(dev, sectors[i]);
+        st = bstripe(h);
+
+        acquire(&st->lock);
+        b = bfind(h, dev, sectors[i]);
+        release(&st->lock);
+
+        if (b != NULL) {
+            continue;
+        }
+
+        b = bget(dev, sectors[i]);
+
+        if (b->flags & B_VALID) {
+            brelse(b);
+            continue;
+        }
+
+        b->flags |= B_ASYNC;
+        bufs[nb++] = b;
+
+        if (nb == NREADA) {
+            iderw_async(bufs, nb);
+            nb = 0;
+        }
+    }
+
+    if (nb > 0) {
+        iderw_async(bufs, nb);
+    }
+}
+
 // Write b's contents to disk.  Must be B_BUSY.
 void bwrite (struct buf *b)
 {
@@ -118,14 +346,34 @@ void bwrite (struct buf *b)
     iderw(b);
 }
 
+// Write n buffers at once, the disk can merge the writes of adjacent
+// blocks. All must be B_BUSY.
+void bwritev (struct buf **bufs, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if ((bufs[i]->flags & B_BUSY) == 0) {
+            panic("bwritev");
+        }
+
+        bufs[i]->flags |= B_DIRTY;
+    }
+
+    iderwv(bufs, n);
+}
+
 // Release a B_BUSY buffer.
 // Move to the head of the MRU list.
 void brelse (struct buf *b)
 {
+    struct bstripe *st;
+
     if ((b->flags & B_BUSY) == 0) {
         panic("brelse");
     }
 
+    // b is still busy, nobody else can rehash it
     acquire(&bcache.lock);
 
     b->next->prev = b->prev;
@@ -135,9 +383,48 @@ void brelse (struct buf *b)
     bcache.head.next->prev = b;
     bcache.head.next = b;
 
+    st = bstripe(bhash(b->dev, b->sector));
+
+    acquire(&st->lock);
     b->flags &= ~B_BUSY;
     wakeup(b);
+    release(&st->lock);
+
+    // bget may be waiting for a buffer to recycle, it holds bcache.lock
+    // from its search until it sleeps
+    if (bcache.nwait > 0) {
+        wakeup(&bcache);
+    }
 
     release(&bcache.lock);
 }
 
+// Number of buffers in the cache
+int bcachesize (void)
+{
+    return bcache.nbuf;
+}
+
+// Print the buffer cache statistics. No lock, for debugging. The lock
+// waits are the acquisitions that found a bucket lock (or bcache.lock,
+// reported apart) held by another CPU.
+void bstat (void)
+{
+    struct bstripe *st;
+    uint hits, misses, evicts, sleeps, lkwaits;
+
+    hits = misses = evicts = sleeps = lkwaits = 0;
+
+    for (st = bcache.stripes; st < bcache.stripes + NHLOCK; st++) {
+        hits += st->hits;
+        misses += st->misses;
+        evicts += st->evicts;
+        sleeps += st->sleeps;
+        lkwaits += st->lock.ncontend;
+    }
+
+    cprintf("bcache: %d bufs, %d buckets, hits %d, misses %d, evicts %d, "
+            "busy sleeps %d, no free buf %d, lock waits %d (lru %d)\n",
+            bcache.nbuf, bcache.nhash, hits, misses, evicts, sleeps,
+            bcache.nfull, lkwaits, bcache.lock.ncontend);
+}
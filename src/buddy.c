@@ -6,6 +6,7 @@
 #include "mmu.h"
 #include "spinlock.h"
 #include "arm.h"
+#include "proc.h"
 
 
 // this file implement the buddy memory allocator. Each order divides
@@ -14,6 +15,16 @@
 // when blocks are freed. We also use double-linked list to chain together
 // free blocks (for each order), thus allowing fast allocation. There is
 // about 8% overhead (maximum) for this structure.
+//
+// Pages (order PTE_SHIFT blocks) also have a reference count, so that a
+// physical page can be shared by several address spaces (copy-on-write).
+// alloc_page returns a page with one reference, put_page frees the page
+// when the last reference is dropped.
+//
+// Pages are allocated and freed very often (fork, exec, page faults), so
+// each CPU keeps a magazine of free pages. alloc_page and free_page only
+// use the magazine of the current CPU (with interrupts disabled), and
+// take kmem.lock only to refill or drain MAG_BATCH pages at once.
 
 #define MAX_ORD      12
 #define MIN_ORD      6
@@ -40,11 +51,27 @@ struct kmem {
     uint            start;             // start of memory for marks
     uint            start_heap;        // start of allocatable memory
     uint            end;
+    uint16          *refs;             // reference count of each page
+    uint            nfree;             // bytes in the free blocks
     struct order    orders[N_ORD];  // orders used for buddy systems
 };
 
 static struct kmem kmem;
 
+#define MAG_SZ      32          // pages in a magazine
+#define MAG_BATCH   (MAG_SZ/2)  // pages moved to/from the buddy system at once
+
+struct magazine {
+    void    *pages[MAG_SZ];
+    int     n;
+    uint    hits;               // alloc_page served by the magazine
+    uint    refills;            // alloc_page that had to refill it
+    uint    frees;              // pages freed into the magazine
+    uint    drains;             // free_page that had to drain it
+};
+
+static struct magazine mags[NCPU];
+
 // coversion between block id to mark and memory address
 static inline struct mark* get_mark (int order, int idx)
 {
@@ -61,6 +88,11 @@ static inline int mem2blkid (int order, void *mem)
     return ((uint)mem - kmem.start_heap) >> order;
 }
 
+static inline uint16* page_ref (void *v)
+{
+    return kmem.refs + (((uint)v - kmem.start_heap) >> PTE_SHIFT);
+}
+
 static inline int available (uint bitmap, int blk_id)
 {
     return bitmap & (1 << (blk_id & 0x1F));
@@ -103,8 +135,13 @@ void kmem_init2(void *vstart, void *vend)
         n <<= 1;     // each order doubles required marks
     }
 
+    // reserve the page reference counts after the marks
+    kmem.refs = (uint16*)(kmem.start + total * sizeof(*mk));
+    n = len >> PTE_SHIFT;
+    memset(kmem.refs, 0, n * sizeof(uint16));
+
     // add all available memory to the highest order bucket
-    kmem.start_heap = align_up(kmem.start + total * sizeof(*mk), 1 << MAX_ORD);
+    kmem.start_heap = align_up((uint)(kmem.refs + n), 1 << MAX_ORD);
     
     for (i = kmem.start_heap; i < kmem.end; i += (1 << MAX_ORD)){
         kfree ((void*)i, MAX_ORD);
@@ -127,6 +164,7 @@ static void unmark_blk (int order, int blk_id)
     }
 
     mk->bitmap &= ~(1 << (blk_id & 0x1F));
+    kmem.nfree -= 1 << order;
     
     // if it's the last block in the bitmap, delete from the list
     if (mk->bitmap == 0) {
@@ -172,6 +210,7 @@ static void mark_blk (int order, int blk_id)
     }
     
     mk->bitmap |= (1 << (blk_id & 0x1F));
+    kmem.nfree += 1 << order;
     
     // just insert it to the head, no need to keep the list ordered
     if (insert) {
@@ -293,16 +332,139 @@ void kfree (void *mem, int order)
     release(&kmem.lock);
 }
 
+// put a free page into the magazine of this CPU, drain half of the
+// magazine to the buddy system if it is full
+static void mag_free (void *v)
+{
+    struct magazine *m;
+    int i;
+
+    pushcli();
+    m = &mags[mycpu()->id];
+
+    if (m->n == MAG_SZ) {
+        acquire(&kmem.lock);
+
+        for (i = 0; i < MAG_BATCH; i++) {
+            _kfree(m->pages[--m->n], PTE_SHIFT);
+        }
+
+        release(&kmem.lock);
+        m->drains++;
+    }
+
+    m->pages[m->n++] = v;
+    m->frees++;
+    popcli();
+}
+
 // free a page
 void free_page(void *v)
 {
-    kfree (v, PTE_SHIFT);
+    if ((uint)v & (PTE_SZ - 1)) {
+        panic("free_page: unaligned");
+    }
+
+    *page_ref(v) = 0;
+    mag_free(v);
 }
 
 // allocate a page
 void* alloc_page (void)
 {
-    return kmalloc (PTE_SHIFT);
+    struct magazine *m;
+    void *v;
+
+    pushcli();
+    m = &mags[mycpu()->id];
+
+    if (m->n > 0) {
+        m->hits++;
+    } else {
+        acquire(&kmem.lock);
+
+        while ((m->n < MAG_BATCH) && ((v = _kmalloc(PTE_SHIFT)) != NULL)) {
+            m->pages[m->n++] = v;
+        }
+
+        release(&kmem.lock);
+        m->refills++;
+    }
+
+    v = (m->n > 0) ? m->pages[--m->n] : NULL;
+    popcli();
+
+    if (v != NULL) {
+        *page_ref(v) = 1;
+    }
+
+    return v;
+}
+
+// add a reference to a page allocated by alloc_page
+void get_page (void *v)
+{
+    acquire(&kmem.lock);
+
+    if (*page_ref(v) == 0) {
+        panic("get_page: free page");
+    }
+
+    (*page_ref(v))++;
+    release(&kmem.lock);
+}
+
+// drop a reference to a page, free it if it is the last one
+void put_page (void *v)
+{
+    acquire(&kmem.lock);
+
+    if (*page_ref(v) == 0) {
+        panic("put_page: free page");
+    }
+
+    if (--(*page_ref(v)) > 0) {
+        release(&kmem.lock);
+        return;
+    }
+
+    release(&kmem.lock);
+    mag_free(v);
+}
+
+// return the number of references to a page
+int page_refcnt (void *v)
+{
+    return *page_ref(v);
+}
+
+// The number of free pages, in the buddy system and the magazines. No
+// lock, it is only a hint (for the overcommit check of growproc).
+uint free_pages (void)
+{
+    uint n;
+    int i;
+
+    n = kmem.nfree >> PTE_SHIFT;
+
+    for (i = 0; i < ncpu; i++) {
+        n += mags[i].n;
+    }
+
+    return n;
+}
+
+// Print the page magazine statistics. No lock, for debugging.
+void kmemstat (void)
+{
+    struct magazine *m;
+    int i;
+
+    for (i = 0; i < ncpu; i++) {
+        m = &mags[i];
+        cprintf("cpu%d pages: %d cached, alloc hits %d, refills %d, frees %d, drains %d\n",
+                i, m->n, m->hits, m->refills, m->frees, m->drains);
+    }
 }
 
 // round up power of 2, then get the order
@@ -7,12 +7,14 @@ struct buf {
     uint       sector;
     struct buf *prev;  // LRU cache list
     struct buf *next;
+    struct buf *hnext; // hash chain
     struct buf *qnext; // disk queue
-    uchar      data[512];
+    uchar      *data;  // BSIZE bytes of block content
 };
 
 #define B_BUSY  0x1  // buffer is locked by some process
 #define B_VALID 0x2  // buffer has been read from disk
 #define B_DIRTY 0x4  // buffer needs to be written to disk
+#define B_ASYNC 0x8  // read ahead, the disk driver releases the buffer
 
 #endif
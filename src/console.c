@@ -123,8 +123,9 @@ void panic (char *s)
     cli();
 
     cons.locking = 0;
+    uart_sync();
 
-    cprintf("cpu%d: panic: ", cpu->id);
+    cprintf("cpu%d: panic: ", mycpu()->id);
 
     show_callstk(s);
     panicked = 1; // freeze other CPU
@@ -165,6 +166,20 @@ struct {
     uint e;  // Edit index
 } input;
 
+// Print the statistics of kernel subsystems to console. For debugging.
+// Runs when user types ^T on console. No lock, like procdump.
+void statdump (void)
+{
+    picstat();
+    kmemstat();
+    bstat();
+    idestat();
+    logstat();
+    istat();
+    dcachestat();
+    slabstat();
+}
+
 #define C(x)  ((x)-'@')  // Control-x
 void consoleintr (int (*getc) (void))
 {
@@ -178,6 +193,10 @@ void consoleintr (int (*getc) (void))
             procdump();
             break;
 
+        case C('T'):  // Kernel statistics.
+            statdump();
+            break;
+
         case C('U'):  // Kill line.
             while ((input.e != input.w) && (input.buf[(input.e - 1) % INPUT_BUF] != '\n')) {
                 input.e--;
@@ -227,7 +246,7 @@ int consoleread (struct inode *ip, char *dst, int n)
 
     while (n > 0) {
         while (input.r == input.w) {
-            if (proc->killed) {
+            if (myproc()->killed) {
                 release(&input.lock);
                 ilock(ip);
                 return -1;
@@ -264,17 +283,35 @@ int consoleread (struct inode *ip, char *dst, int n)
 
 int consolewrite (struct inode *ip, char *buf, int n)
 {
-    int i;
+    int i, m, locking;
 
     iunlock(ip);
 
-    acquire(&cons.lock);
+    // queue what fits in the uart ring under cons.lock, like consputc,
+    // and wait for room without it.
+    for (i = 0; i < n; i += m) {
+        locking = cons.locking;
 
-    for (i = 0; i < n; i++) {
-        consputc(buf[i] & 0xff);
-    }
+        if (locking) {
+            acquire(&cons.lock);
+        }
 
-    release(&cons.lock);
+        if (panicked) {
+            cli();
+            while (1)
+                ;
+        }
+
+        m = uartwrite(buf + i, n - i);
+
+        if (locking) {
+            release(&cons.lock);
+        }
+
+        if (m == 0) {
+            uartwait();
+        }
+    }
 
     ilock(ip);
 
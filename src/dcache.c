@@ -0,0 +1,241 @@
+// Name cache: maps (directory, name) to the i-number and the offset of
+// the directory entry, so that path lookups do not read the directories.
+// A negative entry (i-number 0) records that a name is not there.
+//
+// The entries are hashed by (dev, directory, name), and kept on a LRU
+// list. They are allocated from a slab cache, up to NDENTRY of them,
+// then the least recently used entry is recycled.
+//
+// The cache is kept up to date by dirlookup, dirlink and dirunlink in
+// fs.c, all called with the directory locked, so the entries of a
+// directory are consistent with it. dcache.gen changes each time a
+// positive entry is recycled or an entry cannot be recorded: a directory
+// whose entries have all been cached (see dirlookup) is complete as long
+// as gen does not change, and a lookup of a name not in the cache can
+// fail without reading it.
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "fs.h"
+
+struct dentry {
+    uint            dev;
+    uint            dir;        // i-number of the directory
+    char            name[DIRSIZ];
+    uint            inum;       // 0 for a negative entry
+    uint            off;        // offset of the dirent in the directory
+
+    struct dentry   *hnext;     // hash chain
+    struct dentry   *next;      // LRU list, most recently used first
+    struct dentry   *prev;
+};
+
+#define NDHASH  (PTE_SZ / sizeof(struct dentry*))
+
+static struct {
+    struct spinlock     lock;
+    struct kmem_cache   *cache;
+    struct dentry       **hash;     // NDHASH chains
+    struct dentry       head;       // LRU list
+    int                 nentry;
+    uint                gen;
+
+    // statistics
+    uint                hits;
+    uint                neghits;
+    uint                misses;
+} dcache;
+
+void dcacheinit (void)
+{
+    initlock(&dcache.lock, "dcache");
+
+    dcache.cache = kmem_cache_create("dentry", sizeof(struct dentry), 0);
+
+    if ((dcache.cache == 0) || (dcache.hash = alloc_page()) == 0) {
+        panic("dcacheinit");
+    }
+
+    memset(dcache.hash, 0, PTE_SZ);
+
+    dcache.head.next = dcache.head.prev = &dcache.head;
+    dcache.gen = 1;
+}
+
+static uint dhash (uint dev, uint dir, char *name)
+{
+    uint h;
+    int i;
+
+    h = dev * 31 + dir;
+
+    for (i = 0; i < DIRSIZ && name[i]; i++) {
+        h = h * 33 + name[i];
+    }
+
+    return h % NDHASH;
+}
+
+// find the entry. Caller holds the lock.
+static struct dentry* dfind (uint h, uint dev, uint dir, char *name)
+{
+    struct dentry *d;
+
+    for (d = dcache.hash[h]; d != 0; d = d->hnext) {
+        if (d->dev == dev && d->dir == dir && namecmp(d->name, name) == 0) {
+            return d;
+        }
+    }
+
+    return 0;
+}
+
+static void lru_unlink (struct dentry *d)
+{
+    d->next->prev = d->prev;
+    d->prev->next = d->next;
+}
+
+// move d to the front of the LRU list
+static void lru_front (struct dentry *d)
+{
+    d->next = dcache.head.next;
+    d->prev = &dcache.head;
+    dcache.head.next->prev = d;
+    dcache.head.next = d;
+}
+
+static void dunhash (struct dentry *d)
+{
+    struct dentry **pp;
+
+    for (pp = &dcache.hash[dhash(d->dev, d->dir, d->name)]; *pp; pp = &(*pp)->hnext) {
+        if (*pp == d) {
+            *pp = d->hnext;
+            break;
+        }
+    }
+}
+
+// Look up name in directory dir. Return 1 and set *inum and *off if the
+// name is there, 0 if it is known not to be there, -1 if not cached.
+int dcache_lookup (uint dev, uint dir, char *name, uint *inum, uint *off)
+{
+    struct dentry *d;
+    int r;
+
+    acquire(&dcache.lock);
+
+    if ((d = dfind(dhash(dev, dir, name), dev, dir, name)) == 0) {
+        dcache.misses++;
+        release(&dcache.lock);
+        return -1;
+    }
+
+    lru_unlink(d);
+    lru_front(d);
+
+    if (d->inum == 0) {
+        dcache.neghits++;
+        r = 0;
+    } else {
+        dcache.hits++;
+        *inum = d->inum;
+        *off = d->off;
+        r = 1;
+    }
+
+    release(&dcache.lock);
+    return r;
+}
+
+// Record that name in directory dir is i-number inum (0 if it is not
+// there), with the dirent at offset off.
+void dcache_enter (uint dev, uint dir, char *name, uint inum, uint off)
+{
+    struct dentry *d;
+    uint h;
+
+    acquire(&dcache.lock);
+    h = dhash(dev, dir, name);
+
+    if ((d = dfind(h, dev, dir, name)) != 0) {
+        lru_unlink(d);
+        d->inum = inum;
+        d->off = off;
+        lru_front(d);
+
+        release(&dcache.lock);
+        return;
+    }
+
+    // the slab cache does not sleep, it can be called with the lock
+    if ((dcache.nentry < NDENTRY) && (d = kmem_cache_alloc(dcache.cache)) != 0) {
+        dcache.nentry++;
+
+    } else if ((d = dcache.head.prev) != &dcache.head) {
+        // recycle the least recently used entry
+        lru_unlink(d);
+        dunhash(d);
+
+        if (d->inum != 0) {
+            dcache.gen++;
+        }
+
+    } else {
+        // no memory, and nothing cached: the name is not recorded, so
+        // no directory scanned meanwhile may be taken as complete
+        dcache.gen++;
+        release(&dcache.lock);
+        return;
+    }
+
+    d->dev = dev;
+    d->dir = dir;
+    strncpy(d->name, name, DIRSIZ);
+    d->inum = inum;
+    d->off = off;
+    d->hnext = dcache.hash[h];
+    dcache.hash[h] = d;
+    lru_front(d);
+
+    release(&dcache.lock);
+}
+
+// The generation of the cache: a directory is complete in the cache if
+// no positive entry has been recycled since all its entries were entered.
+uint dcache_gen (void)
+{
+    return dcache.gen;
+}
+
+// Forget the entries of directory dir (it is being freed).
+void dcache_purge (uint dev, uint dir)
+{
+    struct dentry *d, *next;
+
+    acquire(&dcache.lock);
+
+    for (d = dcache.head.next; d != &dcache.head; d = next) {
+        next = d->next;
+
+        if (d->dev == dev && d->dir == dir) {
+            lru_unlink(d);
+            dunhash(d);
+            dcache.nentry--;
+            kmem_cache_free(dcache.cache, d);
+        }
+    }
+
+    release(&dcache.lock);
+}
+
+// Print the name cache statistics. No lock, for debugging.
+void dcachestat (void)
+{
+    cprintf("dcache: %d entries, hits %d, negative hits %d, misses %d\n",
+            dcache.nentry, dcache.hits, dcache.neghits, dcache.misses);
+}
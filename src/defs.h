@@ -42,8 +42,12 @@ void            show_callstk (char *);
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
+void            breada(uint, uint*, int);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
+void            bwritev(struct buf**, int);
+void            bstat(void);
+int             bcachesize(void);
 
 // buddy.c
 void            kmem_init (void);
@@ -52,6 +56,11 @@ void*           kmalloc (int order);
 void            kfree (void *mem, int order);
 void            free_page(void *v);
 void*           alloc_page (void);
+uint            free_pages (void);
+void            get_page (void *v);
+void            put_page (void *v);
+int             page_refcnt (void *v);
+void            kmemstat (void);
 void            kmem_test_b (void);
 int             get_order (uint32 v);
 
@@ -59,8 +68,17 @@ int             get_order (uint32 v);
 void            consoleinit(void);
 void            cprintf(char*, ...);
 void            consoleintr(int(*)(void));
+void            statdump(void);
 void            panic(char*) __attribute__((noreturn));
 
+// dcache.c
+void            dcacheinit(void);
+int             dcache_lookup(uint, uint, char*, uint*, uint*);
+void            dcache_enter(uint, uint, char*, uint, uint);
+uint            dcache_gen(void);
+void            dcache_purge(uint, uint);
+void            dcachestat(void);
+
 // exec.c
 int             exec(char*, char**);
 
@@ -74,27 +92,35 @@ int             filestat(struct file*, struct stat*);
 int             filewrite(struct file*, char*, int n);
 
 // fs.c
+void            fsinit(int);
 void            readsb(int dev, struct superblock *sb);
 int             dirlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
+void            dirunlink(struct inode*, char*, uint);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
 void            iinit(void);
 void            ilock(struct inode*);
 void            iput(struct inode*);
+void            istat(void);
 void            iunlock(struct inode*);
 void            iunlockput(struct inode*);
+int             iholding(struct inode*);
 void            iupdate(struct inode*);
 int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, char*, uint, uint);
+void            ireadahead(struct inode*, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, char*, uint, uint);
 
 // ide.c
 void            ideinit(void);
 void            iderw(struct buf*);
+void            iderwv(struct buf**, int);
+void            iderw_async(struct buf**, int);
+void            idestat(void);
 
 // kalloc.c
 /*char*           kalloc(void);
@@ -108,17 +134,42 @@ void            initlog(void);
 void            log_write(struct buf*);
 void            begin_trans();
 void            commit_trans();
+void            log_commit(void);
+void            log_flush(void);
+int             log_ncommits(void);
+void            logstat(void);
 
 // picirq.c
 void            pic_enable(int, ISR);
 void            pic_init(void*);
 void            pic_dispatch (struct trapframe *tp);
+void            pic_setprio(int, int);
+void            picstat(void);
+
+// pl181.c
+int             sd_init(void*);
+void            sd_enable_intr(ISR);
+void            sd_start(struct buf*, uint, int, int);
+int             sd_intr(void);
+
+// slab.c
+struct kmem_cache;
+void            slabinit(void);
+struct kmem_cache* kmem_cache_create(char*, uint, void (*)(void*));
+void*           kmem_cache_alloc(struct kmem_cache*);
+void            kmem_cache_free(struct kmem_cache*, void*);
+void            slabstat(void);
 
 // pipe.c
+void            pipeinit(void);
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, char*, int);
 int             pipewrite(struct pipe*, char*, int);
+int             pipesize(struct pipe*);
+int             piperesize(struct pipe*, int);
+int             pipesplicein(struct pipe*, struct file*, int);
+int             pipespliceout(struct pipe*, struct file*, int);
 
 //PAGEBREAK: 16
 // proc.c
@@ -136,6 +187,9 @@ void            userinit(void);
 int             wait(void);
 void            wakeup(void*);
 void            yield(void);
+void            preempt(void);
+int             setpriority(int, int);
+struct proc*    kthread(char*, void (*)(void));
 
 // swtch.S
 void            swtch(struct context**, struct context*);
@@ -148,13 +202,17 @@ void            release(struct spinlock*);
 
 // string.c
 int             memcmp(const void*, const void*, uint);
-void*           memmove(void*, const void*, uint);
-void*           memset(void*, int, uint);
 char*           safestrcpy(char*, const char*, int);
 int             strlen(const char*);
 int             strncmp(const char*, const char*, uint);
 char*           strncpy(char*, const char*, int);
 
+// string_asm.S
+void            copy_page(void*, void*);
+void*           memmove(void*, const void*, uint);
+void*           memset(void*, int, uint);
+void            zero_page(void*);
+
 // syscall.c
 int             argint(int, int*);
 int             argptr(int, char**, int);
@@ -165,11 +223,13 @@ void            syscall(void);
 
 // timer.c
 void            timer_init(int hz);
+uint            timer_usec(void);
 extern struct   spinlock tickslock;
 
 // trap.c
 extern uint     ticks;
 void            trap_init(void);
+void            trap_initcpu(void);
 void            dump_trapframe (struct trapframe *tf);
 
 // trap_asm.S
@@ -185,9 +245,12 @@ void            trap_fiq(void);
 // uart.c
 void            uart_init(void*);
 void            uartputc(int);
+int             uartwrite(char*, int);
+void            uartwait(void);
 int             uartgetc(void);
 void            micro_delay(int us);
-void            uart_enable_rx();
+void            uart_enable_intr(void);
+void            uart_sync(void);
 
 // vm.c
 int             allocuvm(pde_t*, uint, uint);
@@ -196,6 +259,8 @@ void            freevm(pde_t*);
 void            inituvm(pde_t*, char*, uint);
 int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
 pde_t*          copyuvm(pde_t*, uint);
+int             cowuvm(pde_t*, uint);
+int             faultuvm(struct proc*, uint, int);
 void            switchuvm(struct proc*);
 int             copyout(pde_t*, uint, void*, uint);
 void            clearpteu(pde_t *pgdir, char *uva);
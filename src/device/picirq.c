@@ -7,17 +7,21 @@
 #include "mmu.h"
 
 // PL190 supports the vectored interrupts and non-vectored interrupts.
-// In this code, we use non-vected interrupts (aka. simple interrupt).
-// The flow to handle simple interrupts is as the following:
+// In this code, we use non-vected interrupts (aka. simple interrupt),
+// and prioritize the sources in software:
 //		1. an interrupt (IRQ) occurs, trap.c branches to our IRQ handler
-//		2. read the VICIRQStatus register, for each source generating
-//		   the interrrupt:
-//			2.1 locate the correct ISR
-//			2.2 execute the ISR
-//			2.3 clear the interrupt
+//		2. read the VICIRQStatus register, take the pending sources of the
+//		   highest priority level, pick one of them with CLZ
+//			2.1 execute its ISR, which clears the interrupt
+//			2.2 read the status again, a more urgent source may be pending
 //		3 return to trap.c, which will resume interrupted routines
+// Each source is handled at most once per IRQ, so a source that does
+// not clear its interrupt cannot starve the others.
 // Note: must not read VICVectorAddr
-
+//
+// For each source, we count the interrupts, the time from the IRQ to the
+// start of its ISR (waiting behind other sources), and a histogram of
+// the time spent in the ISR, in power of 2 microseconds.
 
 // define the register offsets (in the unit of 4 bytes). The base address
 // of the VIC depends on the board
@@ -32,8 +36,18 @@ static volatile uint* vic_base;
 #define VIC_PROTECTIOIN	8 // who can access: user or privileged
 
 #define NUM_INTSRC		32 // numbers of interrupt source supported
+#define NUM_PRIO		4  // priority levels, 0 is the most urgent
+#define NUM_HIST		8  // buckets of the ISR time histogram
 
 static ISR isrs[NUM_INTSRC];
+static uint prio_mask[NUM_PRIO];	// the sources of each level
+
+static struct {
+    uint	count;
+    uint	wait;				// total time from the IRQ to the ISR
+    uint	maxwait;
+    uint	hist[NUM_HIST];		// ISR time < 1, 2, 4, ... us
+} stats[NUM_INTSRC];
 
 static void default_isr (struct trapframe *tf, int n)
 {
@@ -52,6 +66,25 @@ void pic_init (void * base)
     for (i = 0; i < NUM_INTSRC; i++) {
         isrs[i] = default_isr;
     }
+
+    // all at the lowest priority until told otherwise
+    prio_mask[NUM_PRIO - 1] = 0xFFFFFFFF;
+}
+
+// set the priority of interrupt source n, 0 is the highest
+void pic_setprio (int n, int prio)
+{
+    int i;
+
+    if ((n<0) || (n >= NUM_INTSRC) || (prio < 0) || (prio >= NUM_PRIO)) {
+        panic ("invalid interrupt priority");
+    }
+
+    for (i = 0; i < NUM_PRIO; i++) {
+        prio_mask[i] &= ~(1 << n);
+    }
+
+    prio_mask[prio] |= (1 << n);
 }
 
 // enable an interrupt (with the ISR)
@@ -77,20 +110,75 @@ void pic_disable (int n)
     isrs[n] = default_isr;
 }
 
+// the source to handle next among pending: the most urgent level, and
+// in a level, the highest numbered source
+static int pic_pick (uint pending)
+{
+    int i;
+
+    for (i = 0; i < NUM_PRIO; i++) {
+        if (pending & prio_mask[i]) {
+            return 31 - __builtin_clz(pending & prio_mask[i]);
+        }
+    }
+
+    return -1;
+}
+
 // dispatch the interrupt
 void pic_dispatch (struct trapframe *tp)
 {
-    uint intstatus;
-    int		i;
+    uint done, t0, t1, t2, d;
+    int n, b;
 
-    intstatus = vic_base[VIC_IRQSTATUS];
+    done = 0;
+    t0 = timer_usec();
 
-    for (i = 0; i < NUM_INTSRC; i++) {
-        if (intstatus & (1<<i)) {
-            isrs[i](tp, i);
+    while ((n = pic_pick(vic_base[VIC_IRQSTATUS] & ~done)) >= 0) {
+        done |= (1 << n);
+
+        t1 = timer_usec();
+        isrs[n](tp, n);
+        t2 = timer_usec();
+
+        stats[n].count++;
+        stats[n].wait += t1 - t0;
+
+        if (t1 - t0 > stats[n].maxwait) {
+            stats[n].maxwait = t1 - t0;
         }
-    }
 
-    intstatus = vic_base[VIC_IRQSTATUS];
+        for (b = 0, d = t2 - t1; (d > 0) && (b < NUM_HIST - 1); b++) {
+            d >>= 1;
+        }
+
+        stats[n].hist[b]++;
+    }
 }
 
+// Print the interrupt statistics. No lock, for debugging.
+void picstat (void)
+{
+    int i, p, b;
+
+    for (i = 0; i < NUM_INTSRC; i++) {
+        if (stats[i].count == 0) {
+            continue;
+        }
+
+        for (p = 0; !(prio_mask[p] & (1 << i)); p++)
+            ;
+
+        cprintf("irq %d: prio %d, %d intrs, wait avg %d max %d us, isr us:",
+                i, p, stats[i].count, stats[i].wait / stats[i].count,
+                stats[i].maxwait);
+
+        for (b = 0; b < NUM_HIST - 1; b++) {
+            cprintf(" <%d:%d", 1 << b, stats[i].hist[b]);
+        }
+
+        cprintf(" more:%d", stats[i].hist[b]);
+
+        cprintf("\n");
+    }
+}
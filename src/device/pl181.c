@@ -0,0 +1,278 @@
+// driver for ARM PrimeCell Multimedia Card Interface (PL181) with a SD card
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "arm.h"
+#include "memlayout.h"
+#include "fs.h"
+#include "buf.h"
+
+// The PL181 has no DMA on the VersatilePB, data go through a 16-word FIFO.
+// A request is a run of buffers of contiguous sectors (linked by qnext),
+// transferred with one single or multiple block command. The interrupt
+// handler moves the data between the FIFO and the buffers. The caller
+// (ide.c) serializes the requests and holds its lock around sd_start()
+// and sd_intr().
+
+static volatile uint *sd_base;
+
+#define SD_POWER        0   // power control
+#define SD_CLOCK        1   // clock control
+#define SD_ARG          2   // command argument
+#define SD_CMD          3   // command
+#define SD_RESPCMD      4   // command index of the last response
+#define SD_RESP0        5   // response (4 words for long responses)
+#define SD_DATATIMER    9   // data timeout, in card bus clocks
+#define SD_DATALEN      10  // bytes to transfer
+#define SD_DATACTRL     11  // data control
+#define SD_DATACNT      12  // bytes left to transfer
+#define SD_STATUS       13  // status
+#define SD_CLEAR        14  // clear the static status bits
+#define SD_MASK0        15  // interrupt mask
+#define SD_FIFO         32  // the data FIFO
+
+// bits in the command register
+#define CMD_RESP        (1 << 6)    // wait for a response
+#define CMD_LONGRESP    (1 << 7)    // 136-bit response
+#define CMD_ENABLE      (1 << 10)   // the command path state machine
+
+// bits in the data control register
+#define DATA_ENABLE     (1 << 0)
+#define DATA_READ       (1 << 1)    // from the card to the controller
+#define DATA_BLK512     (9 << 4)    // log2 of the block size
+
+// bits in the status register
+#define ST_CMDCRCFAIL   (1 << 0)
+#define ST_DATACRCFAIL  (1 << 1)
+#define ST_CMDTIMEOUT   (1 << 2)
+#define ST_DATATIMEOUT  (1 << 3)
+#define ST_TXUNDERRUN   (1 << 4)
+#define ST_RXOVERRUN    (1 << 5)
+#define ST_CMDRESPEND   (1 << 6)
+#define ST_CMDSENT      (1 << 7)
+#define ST_DATAEND      (1 << 8)
+#define ST_TXHALFEMPTY  (1 << 14)
+#define ST_TXFIFOFULL   (1 << 16)
+#define ST_RXDATAAVLBL  (1 << 21)
+
+#define ST_CLEARALL     0x7FF       // the static bits
+#define ST_DATAERR      (ST_DATACRCFAIL|ST_DATATIMEOUT|ST_TXUNDERRUN|ST_RXOVERRUN)
+
+// SD commands
+#define GO_IDLE_STATE       0
+#define ALL_SEND_CID        2
+#define SEND_RELATIVE_ADDR  3
+#define SELECT_CARD         7
+#define SEND_IF_COND        8
+#define STOP_TRANSMISSION   12
+#define SET_BLOCKLEN        16
+#define READ_SINGLE_BLOCK   17
+#define READ_MULTIPLE_BLOCK 18
+#define WRITE_BLOCK         24
+#define WRITE_MULTIPLE_BLOCK 25
+#define APP_CMD             55
+#define SD_SEND_OP_COND     41  // application command
+
+#define OCR_READY       (1U << 31)  // the card has powered up
+#define OCR_CCS         (1 << 30)   // high capacity, block addressing
+#define OCR_VOLTAGE     0x00FF8000  // 2.7V to 3.6V
+
+static struct {
+    uint        rca;        // relative card address
+    int         blkaddr;    // SDHC: the address is in blocks, not bytes
+
+    struct buf  *run;       // the request in progress
+    struct buf  *cur;       // the buffer being transferred
+    uint        off;        // bytes of cur transferred
+    int         write;
+    int         nsect;
+} sd;
+
+// send a command and wait for its response. Return the status bits.
+static uint sd_cmd (uint cmd, uint arg, uint flags)
+{
+    uint st;
+
+    sd_base[SD_CLEAR] = ST_CLEARALL;
+    sd_base[SD_ARG] = arg;
+    sd_base[SD_CMD] = cmd | flags | CMD_ENABLE;
+
+    do {
+        st = sd_base[SD_STATUS];
+    } while (!(st & (ST_CMDRESPEND | ST_CMDSENT | ST_CMDTIMEOUT | ST_CMDCRCFAIL)));
+
+    sd_base[SD_CLEAR] = ST_CLEARALL;
+    return st;
+}
+
+// send a command with a short response, panic on timeout
+static uint sd_cmd_r (uint cmd, uint arg)
+{
+    if (sd_cmd(cmd, arg, CMD_RESP) & ST_CMDTIMEOUT) {
+        panic("sd: command timeout");
+    }
+
+    return sd_base[SD_RESP0];
+}
+
+// initialize the controller and bring the card to the transfer state.
+// Polled, interrupts are not needed this early. Return 0 if no card.
+int sd_init (void *addr)
+{
+    uint ocr, hcs;
+    int i;
+
+    sd_base = addr;
+
+    sd_base[SD_POWER] = 0x3;        // power on
+    sd_base[SD_CLOCK] = 1 << 8;     // enable the clock
+    sd_base[SD_MASK0] = 0;
+
+    sd_cmd(GO_IDLE_STATE, 0, 0);
+
+    // a version 2 card echoes the check pattern and may be SDHC
+    hcs = 0;
+
+    if (!(sd_cmd(SEND_IF_COND, 0x1AA, CMD_RESP) & ST_CMDTIMEOUT)) {
+        hcs = OCR_CCS;
+    }
+
+    for (i = 0; i < 1000; i++) {
+        if (sd_cmd(APP_CMD, 0, CMD_RESP) & ST_CMDTIMEOUT) {
+            return 0;
+        }
+
+        sd_cmd(SD_SEND_OP_COND, hcs | OCR_VOLTAGE, CMD_RESP);
+        ocr = sd_base[SD_RESP0];
+
+        if (ocr & OCR_READY) {
+            break;
+        }
+
+        micro_delay(1000);
+    }
+
+    if (!(ocr & OCR_READY)) {
+        return 0;
+    }
+
+    sd.blkaddr = (ocr & OCR_CCS) != 0;
+
+    sd_cmd(ALL_SEND_CID, 0, CMD_RESP | CMD_LONGRESP);
+    sd.rca = sd_cmd_r(SEND_RELATIVE_ADDR, 0) >> 16;
+    sd_cmd_r(SELECT_CARD, sd.rca << 16);
+    sd_cmd_r(SET_BLOCKLEN, SECTOR_SIZE);
+
+    return 1;
+}
+
+// enable the interrupt (after PIC has initialized). The MMCI interrupt
+// comes through the secondary controller, pass it to the PIC directly.
+void sd_enable_intr (ISR isr)
+{
+    volatile uint *sic = P2V(SIC_BASE);
+
+    sic[SIC_PICENSET] = 1 << PIC_MMCI0;
+    pic_enable(PIC_MMCI0, isr);
+}
+
+// start the transfer of a run of buffers with nsect sectors from sector
+void sd_start (struct buf *run, uint sector, int nsect, int write)
+{
+    uint cmd;
+
+    sd.run = sd.cur = run;
+    sd.off = 0;
+    sd.write = write;
+    sd.nsect = nsect;
+
+    if (!sd.blkaddr) {
+        sector *= SECTOR_SIZE;
+    }
+
+    if (write) {
+        cmd = (nsect > 1) ? WRITE_MULTIPLE_BLOCK : WRITE_BLOCK;
+    } else {
+        cmd = (nsect > 1) ? READ_MULTIPLE_BLOCK : READ_SINGLE_BLOCK;
+    }
+
+    sd_base[SD_DATATIMER] = 0xFFFFFFFF;
+    sd_base[SD_DATALEN] = nsect * SECTOR_SIZE;
+
+    if (sd_cmd(cmd, sector, CMD_RESP) & (ST_CMDTIMEOUT | ST_CMDCRCFAIL)) {
+        panic("sd_start: command failed");
+    }
+
+    sd_base[SD_MASK0] = ST_DATAEND | ST_DATAERR |
+                        (write ? ST_TXHALFEMPTY : ST_RXDATAAVLBL);
+
+    sd_base[SD_DATACTRL] = DATA_ENABLE | DATA_BLK512 | (write ? 0 : DATA_READ);
+}
+
+// move the data between the FIFO and the buffers of the run
+static void sd_pio (void)
+{
+    uint *p;
+
+    while (sd.cur != NULL) {
+        if (sd.write && (sd_base[SD_STATUS] & ST_TXFIFOFULL)) {
+            break;
+        }
+
+        if (!sd.write && !(sd_base[SD_STATUS] & ST_RXDATAAVLBL)) {
+            break;
+        }
+
+        p = (uint*)(sd.cur->data + sd.off);
+
+        if (sd.write) {
+            sd_base[SD_FIFO] = *p;
+        } else {
+            *p = sd_base[SD_FIFO];
+        }
+
+        if ((sd.off += sizeof(uint)) == BSIZE) {
+            sd.cur = sd.cur->qnext;
+            sd.off = 0;
+        }
+    }
+}
+
+// handle an interrupt of the MMCI. Return 1 if the run is done.
+int sd_intr (void)
+{
+    uint st;
+
+    if (sd.run == NULL) {
+        sd_base[SD_MASK0] = 0;
+        return 0;
+    }
+
+    sd_pio();
+
+    st = sd_base[SD_STATUS];
+
+    if (st & ST_DATAERR) {
+        panic("sd_intr: data error");
+    }
+
+    if (sd.cur == NULL) {
+        // all the data are in the FIFO, stop feeding it
+        sd_base[SD_MASK0] = ST_DATAEND | ST_DATAERR;
+    }
+
+    if (!(st & ST_DATAEND)) {
+        return 0;
+    }
+
+    sd_base[SD_MASK0] = 0;
+    sd_base[SD_DATACTRL] = 0;
+    sd_base[SD_CLEAR] = ST_CLEARALL;
+
+    if (sd.nsect > 1) {
+        sd_cmd(STOP_TRANSMISSION, 0, CMD_RESP);
+    }
+
+    sd.run = NULL;
+    return 1;
+}
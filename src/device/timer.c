@@ -14,6 +14,7 @@
 #define TIMER_CURVAL   1	// current value of the counter
 #define TIMER_CONTROL  2	// control register
 #define TIMER_INTCLR   3	// clear (ack) the interrupt (any write clear it)
+#define TIMER_RIS      4	// raw interrupt status
 #define TIMER_MIS      5	// masked interrupt status
 
 // control register bit definitions
@@ -58,6 +59,29 @@ void isr_timer (struct trapframe *tp, int irq_idx)
     ack_timer();
 }
 
+// microseconds since the timer started, it wraps around in about 71
+// minutes. The counter of timer0 counts down from CLK_HZ/HZ in each tick.
+uint timer_usec (void)
+{
+    volatile uint * timer0 = P2V(TIMER0);
+    uint t, val;
+
+    pushcli();
+
+    t = ticks;
+    val = timer0[TIMER_CURVAL];
+
+    // the counter has wrapped but the interrupt is not handled yet
+    if (timer0[TIMER_RIS] & 0x01) {
+        t++;
+        val = timer0[TIMER_CURVAL];
+    }
+
+    popcli();
+
+    return t * (CLK_HZ / HZ) + (timer0[TIMER_LOAD] - val);
+}
+
 // a short delay, use timer 1 as the source
 void micro_delay (int us)
 {
@@ -4,6 +4,16 @@
 #include "param.h"
 #include "arm.h"
 #include "memlayout.h"
+#include "spinlock.h"
+
+// Output goes through a ring buffer. Characters are written to the
+// transmit FIFO directly while it has room, the rest wait in the ring
+// and the transmit interrupt (enabled only while the ring is not empty)
+// moves them to the FIFO as it drains. uartwrite takes what fits in the
+// ring and uartwait sleeps for room, uartputc (kernel messages, echo,
+// any context) spins instead.
+// Before the interrupts are enabled and after a panic (uart_sync), the
+// output is polled as there is nobody to drain the ring.
 
 static volatile uint *uart_base;
 void isr_uart (struct trapframe *tf, int idx);
@@ -28,6 +38,15 @@ void isr_uart (struct trapframe *tf, int idx);
 #define UART_RXI	(1 << 4)	// receive interrupt
 #define UART_TXI	(1 << 5)	// transmit interrupt
 #define UART_BITRATE 19200
+#define UART_TXBUF	1024	// size of the transmit ring
+
+static struct {
+    struct spinlock lock;
+    char    buf[UART_TXBUF];
+    uint    r;      // next character to send
+    uint    w;      // next free slot
+    int     intr;   // the transmit interrupt drains the ring
+} tx;
 
 // enable uart
 void uart_init (void *addr)
@@ -35,6 +54,7 @@ void uart_init (void *addr)
     uint left;
 
     uart_base = addr;
+    initlock(&tx.lock, "uart");
 
     // set the bit rate: integer/fractional baud rate registers
     uart_base[UART_IBRD] = UART_CLK / (16 * UART_BITRATE);
@@ -49,16 +69,33 @@ void uart_init (void *addr)
     uart_base[UART_LCR] |= UARTLCR_FEN;
 }
 
-// enable the receive (interrupt) for uart (after PIC has initialized)
-void uart_enable_rx ()
+// enable the interrupts for uart (after PIC has initialized)
+void uart_enable_intr (void)
 {
     uart_base[UART_IMSC] = UART_RXI;
     pic_enable(PIC_UART0, isr_uart);
+    tx.intr = 1;
 }
 
-void uartputc (int c)
+// move characters from the ring to the FIFO while it has room, and
+// have the interrupt tell when there is room again if some are left.
+// Caller holds tx.lock.
+static void uartstart (void)
+{
+    while ((tx.r != tx.w) && !(uart_base[UART_FR] & UARTFR_TXFF)) {
+        uart_base[UART_DR] = tx.buf[tx.r++ % UART_TXBUF];
+    }
+
+    if (tx.r == tx.w) {
+        uart_base[UART_IMSC] &= ~UART_TXI;
+    } else {
+        uart_base[UART_IMSC] |= UART_TXI;
+    }
+}
+
+// send c without the ring, waiting for room in the FIFO
+static void uartputc_poll (int c)
 {
-    // wait a short period if the transmit FIFO is full
     while (uart_base[UART_FR] & UARTFR_TXFF) {
         micro_delay(10);
     }
@@ -66,6 +103,78 @@ void uartputc (int c)
     uart_base[UART_DR] = c;
 }
 
+// Output c, never sleeps. Spins only if the ring is full.
+void uartputc (int c)
+{
+    if (!tx.intr) {
+        uartputc_poll(c);
+        return;
+    }
+
+    acquire(&tx.lock);
+
+    while (tx.w == tx.r + UART_TXBUF) {
+        uartstart();
+    }
+
+    tx.buf[tx.w++ % UART_TXBUF] = c;
+    uartstart();
+
+    release(&tx.lock);
+}
+
+// Output up to n characters from a process, as many as the ring has
+// room for. Never sleeps, return the number of characters taken.
+int uartwrite (char *s, int n)
+{
+    int i;
+
+    if (!tx.intr) {
+        for (i = 0; i < n; i++) {
+            uartputc_poll(s[i] & 0xff);
+        }
+
+        return n;
+    }
+
+    acquire(&tx.lock);
+
+    uartstart();
+
+    for (i = 0; (i < n) && (tx.w != tx.r + UART_TXBUF); i++) {
+        tx.buf[tx.w++ % UART_TXBUF] = s[i];
+    }
+
+    uartstart();
+    release(&tx.lock);
+
+    return i;
+}
+
+// Sleep until the ring has room for uartwrite.
+void uartwait (void)
+{
+    acquire(&tx.lock);
+
+    while (tx.intr && (tx.w == tx.r + UART_TXBUF)) {
+        sleep(&tx.r, &tx.lock);
+    }
+
+    release(&tx.lock);
+}
+
+// Back to polled output, after flushing the ring (for panic). Does not
+// take the lock, its holder may be the one panicking.
+void uart_sync (void)
+{
+    tx.intr = 0;
+    uart_base[UART_IMSC] &= ~UART_TXI;
+
+    while (tx.r != tx.w) {
+        uartputc_poll(tx.buf[tx.r++ % UART_TXBUF]);
+    }
+}
+
 //poll the UART for data
 int uartgetc (void)
 {
@@ -78,6 +187,15 @@ int uartgetc (void)
 
 void isr_uart (struct trapframe *tf, int idx)
 {
+    if (uart_base[UART_MIS] & UART_TXI) {
+        uart_base[UART_ICR] = UART_TXI;
+
+        acquire(&tx.lock);
+        uartstart();
+        wakeup(&tx.r);
+        release(&tx.lock);
+    }
+
     if (uart_base[UART_MIS] & UART_RXI) {
         consoleintr(uartgetc);
     }
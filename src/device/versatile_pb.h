@@ -26,10 +26,18 @@
 #define TIMER1          0x101E2020
 #define CLK_HZ          1000000     // the clock is 1MHZ
 
+#define MMCI0           0x10005000  // PL181 with the SD card (the disk)
+
+// the secondary interrupt controller, its sources 21 to 30 can be passed
+// to the same sources of the PIC (VIC)
+#define SIC_BASE        0x10003000
+#define SIC_PICENSET    8           // (in units of 4 bytes)
+
 #define VIC_BASE        0x10140000
 #define PIC_TIMER01     4
 #define PIC_TIMER23     5
 #define PIC_UART0       12
 #define PIC_GRAPHIC     19
+#define PIC_MMCI0       22
 
 #endif
@@ -7,18 +7,25 @@
 #include "elf.h"
 #include "arm.h"
 
-// load a user program for execution
+// load a user program for execution. The program segments are not read
+// in here, only recorded in the process. Their pages are read from the
+// executable (or zero-filled for bss) on the first access, see faultuvm.
 int exec (char *path, char **argv)
 {
+    struct proc *curproc = myproc();
     struct elfhdr elf;
     struct inode *ip;
+    struct inode *exe;
+    struct inode *oldexe;
     struct proghdr ph;
+    struct seg segs[NSEG];
     pde_t *pgdir;
     pde_t *oldpgdir;
     char *s;
     char *last;
     int i;
     int off;
+    int nseg;
     uint argc;
     uint sz;
     uint sp;
@@ -29,6 +36,8 @@ int exec (char *path, char **argv)
     }
 
     ilock(ip);
+    pgdir = 0;
+    exe = 0;
 
     // Check ELF header
     if (readi(ip, (char*) &elf, 0, sizeof(elf)) < sizeof(elf)) {
@@ -39,14 +48,13 @@ int exec (char *path, char **argv)
         goto bad;
     }
 
-    pgdir = 0;
-
     if ((pgdir = kpt_alloc()) == 0) {
         goto bad;
     }
 
-    // Load program into memory.
+    // Reserve the address space for the program.
     sz = 0;
+    nseg = 0;
 
     for (i = 0, off = elf.phoff; i < elf.phnum; i++, off += sizeof(ph)) {
         if (readi(ip, (char*) &ph, off, sizeof(ph)) != sizeof(ph)) {
@@ -57,20 +65,26 @@ int exec (char *path, char **argv)
             continue;
         }
 
-        if (ph.memsz < ph.filesz) {
+        if ((ph.memsz < ph.filesz) || (nseg >= NSEG)) {
             goto bad;
         }
 
-        if ((sz = allocuvm(pgdir, sz, ph.vaddr + ph.memsz)) == 0) {
+        if ((ph.vaddr + ph.memsz < ph.vaddr) || (ph.vaddr + ph.memsz >= UADDR_SZ)) {
             goto bad;
         }
 
-        if (loaduvm(pgdir, (char*) ph.vaddr, ip, ph.off, ph.filesz) < 0) {
-            goto bad;
-        }
+        segs[nseg].va = ph.vaddr;
+        segs[nseg].memsz = ph.memsz;
+        segs[nseg].off = ph.off;
+        segs[nseg].filesz = ph.filesz;
+        nseg++;
+
+        sz = UMAX(sz, ph.vaddr + ph.memsz);
     }
 
-    iunlockput(ip);
+    // keep a reference to the executable to page in from
+    iunlock(ip);
+    exe = ip;
     ip = 0;
 
     // Allocate two pages at the next page boundary.
@@ -103,8 +117,8 @@ int exec (char *path, char **argv)
     ustack[argc] = 0;
 
     // in ARM, parameters are passed in r0 and r1
-    proc->tf->r0 = argc;
-    proc->tf->r1 = sp - (argc + 1) * 4;
+    curproc->tf->r0 = argc;
+    curproc->tf->r1 = sp - (argc + 1) * 4;
 
     sp -= (argc + 1) * 4;
 
@@ -119,17 +133,28 @@ int exec (char *path, char **argv)
         }
     }
 
-    safestrcpy(proc->name, last, sizeof(proc->name));
+    safestrcpy(curproc->name, last, sizeof(curproc->name));
 
     // Commit to the user image.
-    oldpgdir = proc->pgdir;
-    proc->pgdir = pgdir;
-    proc->sz = sz;
-    proc->tf->pc = elf.entry;
-    proc->tf->sp_usr = sp;
-
-    switchuvm(proc);
+    oldpgdir = curproc->pgdir;
+    oldexe = curproc->exe;
+    curproc->pgdir = pgdir;
+    curproc->sz = sz;
+    curproc->exe = exe;
+    curproc->nseg = nseg;
+    memmove(curproc->segs, segs, sizeof(segs));
+    curproc->tf->pc = elf.entry;
+    curproc->tf->sp_usr = sp;
+
+    switchuvm(curproc);
     freevm(oldpgdir);
+
+    if (oldexe) {
+        begin_trans();
+        iput(oldexe);
+        commit_trans();
+    }
+
     return 0;
 
     bad: if (pgdir) {
@@ -137,7 +162,15 @@ int exec (char *path, char **argv)
     }
 
     if (ip) {
-        iunlockput(ip);
+        iunlock(ip);
+        exe = ip;
     }
+
+    if (exe) {
+        begin_trans();
+        iput(exe);
+        commit_trans();
+    }
+
     return -1;
 }
@@ -10,14 +10,21 @@
 #include "spinlock.h"
 
 struct devsw devsw[NDEV];
+// File structures are allocated from a slab cache, there can be at most
+// NFILE of them open. The lock protects the reference counts.
 struct {
     struct spinlock lock;
-    struct file file[NFILE];
+    struct kmem_cache *cache;
+    int nfile;
 } ftable;
 
 void fileinit (void)
 {
     initlock(&ftable.lock, "ftable");
+
+    if ((ftable.cache = kmem_cache_create("file", sizeof(struct file), 0)) == 0) {
+        panic("fileinit");
+    }
 }
 
 // Allocate a file structure.
@@ -27,16 +34,24 @@ struct file* filealloc (void)
 
     acquire(&ftable.lock);
 
-    for (f = ftable.file; f < ftable.file + NFILE; f++) {
-        if (f->ref == 0) {
-            f->ref = 1;
-            release(&ftable.lock);
-            return f;
-        }
+    if (ftable.nfile >= NFILE) {
+        release(&ftable.lock);
+        return 0;
     }
 
+    ftable.nfile++;
     release(&ftable.lock);
-    return 0;
+
+    if ((f = kmem_cache_alloc(ftable.cache)) == 0) {
+        acquire(&ftable.lock);
+        ftable.nfile--;
+        release(&ftable.lock);
+        return 0;
+    }
+
+    memset(f, 0, sizeof(*f));
+    f->ref = 1;
+    return f;
 }
 
 // Increment ref count for file f.
@@ -70,10 +85,11 @@ void fileclose (struct file *f)
     }
 
     ff = *f;
-    f->ref = 0;
-    f->type = FD_NONE;
+    ftable.nfile--;
     release(&ftable.lock);
 
+    kmem_cache_free(ftable.cache, f);
+
     if (ff.type == FD_PIPE) {
         pipeclose(ff.pipe, ff.writable);
 
@@ -113,6 +129,7 @@ int fileread (struct file *f, char *addr, int n)
 
     if (f->type == FD_INODE) {
         ilock(f->ip);
+        ireadahead(f->ip, f->off, n);
 
         if ((r = readi(f->ip, addr, f->off, n)) > 0) {
             f->off += r;
@@ -146,11 +163,14 @@ int filewrite (struct file *f, char *addr, int n)
     if (f->type == FD_INODE) {
         // write a few blocks at a time to avoid exceeding
         // the maximum log transaction size, including
-        // i-node, indirect block, allocation blocks,
+        // i-node, indirect blocks (the double indirect and
+        // two indirect ones at a boundary), allocation blocks,
         // and 2 blocks of slop for non-aligned writes.
         // this really belongs lower down, since writei()
         // might be writing a device like the console.
-        max = ((LOGSIZE - 1 - 1 - 2) / 2) * 512;
+        // With MAXOPBLOCKS 32, that is 13 blocks (6.5KB with
+        // 512-byte blocks).
+        max = ((MAXOPBLOCKS - 1 - 3 - 2) / 2) * BSIZE;
         i = 0;
 
         while (i < n) {
@@ -21,7 +21,19 @@ struct inode {
     short   minor;
     short   nlink;
     uint    size;
-    uint    addrs[NDIRECT+1];
+    uint    addrs[NDIRECT+2];
+
+    uint    ralast;     // read-ahead: the last block read
+    uint    rawin;      // read-ahead window, 0 if not sequential
+    uint    raend;      // blocks before raend have been read ahead
+    uint    lastblk;    // the block allocated last, to allocate near it
+    uint    dcgen;      // directory: complete in the name cache if dcache_gen()
+    uint    dirfree;    // directory: no free dirent before this offset
+    struct proc *owner; // the process that set I_BUSY (ilock)
+
+    struct inode *hnext;    // hash chain
+    struct inode *next;     // LRU list of unused inodes
+    struct inode *prev;
 };
 #define I_BUSY 0x1
 #define I_VALID 0x2
@@ -21,16 +21,49 @@
 #include "file.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
+
+#define RA_MIN  4       // read-ahead windows, in blocks
+#define RA_MAX  32
+
+#define DIRCHUNK 32     // dirents read at once by dirlookup
+
 static void itrunc (struct inode*);
+static void fsum_init (int dev);
 
-// Read the super block.
-void readsb (int dev, struct superblock *sb)
+uint bsize = BSIZE_MIN;         // block size, set at mount
+static struct superblock sb0;   // the super block of the root file system
+
+// Mount the root file system on dev. The block size must be known to
+// size the buffer cache, so the super block is read directly from the
+// disk (in a block of BSIZE_MIN). Called once, in a process context.
+void fsinit (int dev)
 {
-    struct buf *bp;
+    static uchar sect[BSIZE_MIN];
+    struct buf b;
 
-    bp = bread(dev, 1);
-    memmove(sb, bp->data, sizeof(*sb));
-    brelse(bp);
+    memset(&b, 0, sizeof(b));
+    b.flags = B_BUSY;
+    b.dev = dev;
+    b.sector = SBOFF / BSIZE_MIN;
+    b.data = sect;
+
+    iderw(&b);
+    memmove(&sb0, sect + SBOFF % BSIZE_MIN, sizeof(sb0));
+
+    if ((sb0.magic != FSMAGIC) || (sb0.bsize < BSIZE_MIN) ||
+        (sb0.bsize > BSIZE_MAX) || (sb0.bsize & (sb0.bsize - 1))) {
+        panic("fsinit: bad super block");
+    }
+
+    bsize = sb0.bsize;
+    binit();
+    fsum_init(dev);
+}
+
+// Read the super block (the copy made at mount, it does not change).
+void readsb (int dev, struct superblock *sb)
+{
+    *sb = sb0;
 }
 
 // Zero a block.
@@ -46,33 +79,153 @@ static void bzero (int dev, int bno)
 
 // Blocks.
 
-// Allocate a zeroed disk block.
-static uint balloc (uint dev)
+// Free space summaries, built at mount: the free blocks in each bitmap
+// block and the free inodes in each inode block, so that balloc and
+// ialloc skip the full ones, and rotors to resume the search where the
+// last one ended. A count changes only while its bitmap (or inode) block
+// is held, and under fsum.lock. The counts are hints when read without
+// holding the block: balloc (ialloc) checks the block anyway.
+static struct {
+    struct spinlock lock;
+    int     *nbfree;    // free blocks of each bitmap block
+    int     nbmap;      // bitmap blocks
+    uint    dataend;    // the first block after the data blocks (the log)
+    uint    brotor;     // where the next search for a block starts
+
+    int     *nifree;    // free inodes of each inode block
+    int     niblk;      // inode blocks
+    uint    irotor;     // where the next search for an inode starts
+} fsum;
+
+// free bit of block b in bitmap block data?
+static inline int bfreebit (uchar *data, uint b)
+{
+    return (data[(b % BPB) / 8] & (1 << (b % 8))) == 0;
+}
+
+// count the free blocks and inodes of the file system on dev
+static void fsum_init (int dev)
 {
-    int b, bi, m;
     struct buf *bp;
-    struct superblock sb;
+    struct dinode *dip;
+    uint b, inum;
+    int k;
 
-    bp = 0;
-    readsb(dev, &sb);
+    initlock(&fsum.lock, "fsum");
 
-    for (b = 0; b < sb.size; b += BPB) {
-        bp = bread(dev, BBLOCK(b, sb.ninodes));
+    fsum.dataend = sb0.size - sb0.nlog;
+    fsum.nbmap = (fsum.dataend + BPB - 1) / BPB;
+    fsum.niblk = sb0.ninodes / IPB + 1;
 
-        for (bi = 0; bi < BPB && b + bi < sb.size; bi++) {
-            m = 1 << (bi % 8);
+    fsum.nbfree = kmalloc(get_order(fsum.nbmap * sizeof(int)));
+    fsum.nifree = kmalloc(get_order(fsum.niblk * sizeof(int)));
 
-            if ((bp->data[bi / 8] & m) == 0) {  // Is block free?
-                bp->data[bi / 8] |= m;  // Mark block in use.
-                log_write(bp);
-                brelse(bp);
-                bzero(dev, b + bi);
-                return b + bi;
-            }
+    if (fsum.nbfree == 0 || fsum.nifree == 0) {
+        panic("fsum_init: no memory");
+    }
+
+    for (k = 0; k < fsum.nbmap; k++) {
+        fsum.nbfree[k] = 0;
+        bp = bread(dev, BBLOCK(k * BPB, sb0.ninodes));
+
+        for (b = k * BPB; b < (k + 1) * BPB && b < fsum.dataend; b++) {
+            fsum.nbfree[k] += bfreebit(bp->data, b);
+        }
+
+        brelse(bp);
+    }
+
+    for (k = 0; k < fsum.niblk; k++) {
+        fsum.nifree[k] = 0;
+        bp = bread(dev, IBLOCK(k * IPB));
+
+        for (inum = k * IPB; inum < (k + 1) * IPB && inum < sb0.ninodes; inum++) {
+            dip = (struct dinode*) bp->data + inum % IPB;
+            fsum.nifree[k] += (inum > 0 && dip->type == 0);
         }
 
         brelse(bp);
     }
+}
+
+// find a free bit in bitmap block data for blocks [from, to)
+static int bscan (uchar *data, uint from, uint to)
+{
+    uint b;
+
+    for (b = from; b < to; b++) {
+        // skip the full bytes
+        if ((b % 8 == 0) && (b + 8 <= to) && (data[(b % BPB) / 8] == 0xFF)) {
+            b += 7;
+            continue;
+        }
+
+        if (bfreebit(data, b)) {
+            return b;
+        }
+    }
+
+    return -1;
+}
+
+// Allocate a zeroed disk block, as close after goal as possible (the
+// previous block of the file, for example), or after the rotor if goal
+// is 0. The search starts in the bitmap block of goal, and skips the
+// bitmap blocks without free blocks.
+static uint balloc (uint dev, uint goal)
+{
+    struct buf *bp;
+    uint start, end;
+    int i, k, b;
+
+    acquire(&fsum.lock);
+
+    if (goal == 0 || goal >= fsum.dataend) {
+        goal = fsum.brotor;
+    }
+
+    k = goal / BPB;
+
+    for (i = 0; i < fsum.nbmap; i++, k = (k + 1) % fsum.nbmap) {
+        if (fsum.nbfree[k] <= 0) {
+            continue;
+        }
+
+        release(&fsum.lock);
+
+        start = k * BPB;
+        end = (k + 1) * BPB < fsum.dataend ? (k + 1) * BPB : fsum.dataend;
+
+        bp = bread(dev, BBLOCK(start, sb0.ninodes));
+
+        // after goal first (the first time), then the whole block
+        b = -1;
+
+        if (i == 0 && goal > start) {
+            b = bscan(bp->data, goal, end);
+        }
+
+        if (b < 0) {
+            b = bscan(bp->data, start, end);
+        }
+
+        acquire(&fsum.lock);
+
+        if (b >= 0) {
+            bp->data[(b % BPB) / 8] |= 1 << (b % 8);  // Mark block in use.
+            fsum.nbfree[k]--;
+            fsum.brotor = b + 1;
+            release(&fsum.lock);
+
+            log_write(bp);
+            brelse(bp);
+            bzero(dev, b);
+            return b;
+        }
+
+        fsum.nbfree[k] = 0;     // it was stale
+        brelse(bp);
+    }
 
     panic("balloc: out of blocks");
 }
@@ -81,11 +234,9 @@ static uint balloc (uint dev)
 static void bfree (int dev, uint b)
 {
     struct buf *bp;
-    struct superblock sb;
     int bi, m;
 
-    readsb(dev, &sb);
-    bp = bread(dev, BBLOCK(b, sb.ninodes));
+    bp = bread(dev, BBLOCK(b, sb0.ninodes));
     bi = b % BPB;
     m = 1 << (bi % 8);
 
@@ -95,6 +246,11 @@ static void bfree (int dev, uint b)
 
     bp->data[bi / 8] &= ~m;
     log_write(bp);
+
+    acquire(&fsum.lock);
+    fsum.nbfree[b / BPB]++;
+    release(&fsum.lock);
+
     brelse(bp);
 }
 
@@ -160,42 +316,89 @@ static void bfree (int dev, uint b)
 // have locked the inodes involved; this lets callers create
 // multi-step atomic operations.
 
+// The in-memory inodes are allocated from a slab cache when first
+// referenced, and hashed by (dev, inum) into icache.hash. When the last
+// reference is dropped, a valid inode stays cached on the LRU list, so
+// reopening a recently used file needs not read its dinode again. At
+// most NINODE inodes are kept this way, the least recently used ones
+// are freed.
+#define NIHASH  (PTE_SZ / sizeof(struct inode*))
+
 struct {
     struct spinlock lock;
-    struct inode inode[NINODE];
+    struct kmem_cache *cache;
+    struct inode **hash;    // NIHASH chains through hnext
+    struct inode lru;       // unused inodes, lru.next is most recently used
+    int ninode;             // inodes cached
+    int nunused;            // inodes on the LRU list
+
+    // statistics
+    uint hits;
+    uint misses;
 } icache;
 
 void iinit (void)
 {
     initlock(&icache.lock, "icache");
+
+    if ((icache.cache = kmem_cache_create("inode", sizeof(struct inode), 0)) == 0) {
+        panic("iinit");
+    }
+
+    if ((icache.hash = alloc_page()) == 0) {
+        panic("iinit: no memory for hash");
+    }
+
+    memset(icache.hash, 0, PTE_SZ);
+    icache.lru.next = icache.lru.prev = &icache.lru;
+
+    dcacheinit();
 }
 
 static struct inode* iget (uint dev, uint inum);
 
 //PAGEBREAK!
 // Allocate a new inode with the given type on device dev.
-// A free inode has a type of zero.
+// A free inode has a type of zero. The search starts at the rotor and
+// skips the inode blocks without free inodes.
 struct inode* ialloc (uint dev, short type)
 {
-    int inum;
+    int i, k;
+    uint inum;
     struct buf *bp;
     struct dinode *dip;
-    struct superblock sb;
 
-    readsb(dev, &sb);
+    acquire(&fsum.lock);
+    k = fsum.irotor / IPB;
 
-    for (inum = 1; inum < sb.ninodes; inum++) {
-        bp = bread(dev, IBLOCK(inum));
-        dip = (struct dinode*) bp->data + inum % IPB;
+    for (i = 0; i < fsum.niblk; i++, k = (k + 1) % fsum.niblk) {
+        if (fsum.nifree[k] <= 0) {
+            continue;
+        }
 
-        if (dip->type == 0) {  // a free inode
-            memset(dip, 0, sizeof(*dip));
-            dip->type = type;
-            log_write(bp);   // mark it allocated on the disk
-            brelse(bp);
-            return iget(dev, inum);
+        release(&fsum.lock);
+        bp = bread(dev, IBLOCK(k * IPB));
+
+        for (inum = k * IPB; inum < (k + 1) * IPB && inum < sb0.ninodes; inum++) {
+            dip = (struct dinode*) bp->data + inum % IPB;
+
+            if (inum > 0 && dip->type == 0) {  // a free inode
+                memset(dip, 0, sizeof(*dip));
+                dip->type = type;
+                log_write(bp);   // mark it allocated on the disk
+                brelse(bp);
+
+                acquire(&fsum.lock);
+                fsum.nifree[k]--;
+                fsum.irotor = inum;
+                release(&fsum.lock);
+
+                return iget(dev, inum);
+            }
         }
 
+        acquire(&fsum.lock);
+        fsum.nifree[k] = 0;     // it was stale
         brelse(bp);
     }
 
@@ -211,6 +414,14 @@ void iupdate (struct inode *ip)
     bp = bread(ip->dev, IBLOCK(ip->inum));
 
     dip = (struct dinode*) bp->data + ip->inum % IPB;
+
+    // iput frees the inode, count it while its block is held
+    if (dip->type != 0 && ip->type == 0) {
+        acquire(&fsum.lock);
+        fsum.nifree[ip->inum / IPB]++;
+        release(&fsum.lock);
+    }
+
     dip->type = ip->type;
     dip->major = ip->major;
     dip->minor = ip->minor;
@@ -225,30 +436,75 @@ void iupdate (struct inode *ip)
 // Find the inode with number inum on device dev
 // and return the in-memory copy. Does not lock
 // the inode and does not read it from disk.
+static inline uint ihash (uint dev, uint inum)
+{
+    return (inum + dev * 31) % NIHASH;
+}
+
+// find the cached inode, take a reference. Caller holds icache.lock.
+static struct inode* ifind (uint dev, uint inum)
+{
+    struct inode *ip;
+
+    for (ip = icache.hash[ihash(dev, inum)]; ip != 0; ip = ip->hnext) {
+        if (ip->dev == dev && ip->inum == inum) {
+            if (ip->ref++ == 0) {
+                // it was unused, take it off the LRU list
+                ip->next->prev = ip->prev;
+                ip->prev->next = ip->next;
+                icache.nunused--;
+            }
+
+            icache.hits++;
+            return ip;
+        }
+    }
+
+    return 0;
+}
+
+// remove ip from its hash chain. Caller holds icache.lock.
+static void iunhash (struct inode *ip)
+{
+    struct inode **pp;
+
+    for (pp = &icache.hash[ihash(ip->dev, ip->inum)]; *pp != 0; pp = &(*pp)->hnext) {
+        if (*pp == ip) {
+            *pp = ip->hnext;
+            break;
+        }
+    }
+
+    icache.ninode--;
+}
+
 static struct inode* iget (uint dev, uint inum)
 {
     struct inode *ip, *empty;
+    uint h;
 
     acquire(&icache.lock);
 
     // Is the inode already cached?
-    empty = 0;
+    if ((ip = ifind(dev, inum)) != 0) {
+        release(&icache.lock);
+        return ip;
+    }
 
-    for (ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++) {
-        if (ip->ref > 0 && ip->dev == dev && ip->inum == inum) {
-            ip->ref++;
-            release(&icache.lock);
-            return ip;
-        }
+    // Allocate a new entry. Allocation does not sleep, but we must
+    // search again if we drop the lock for it.
+    release(&icache.lock);
 
-        if (empty == 0 && ip->ref == 0) {   // Remember empty slot.
-            empty = ip;
-        }
+    if ((empty = kmem_cache_alloc(icache.cache)) == 0) {
+        panic("iget: out of memory");
     }
 
-    // Recycle an inode cache entry.
-    if (empty == 0) {
-        panic("iget: no inodes");
+    acquire(&icache.lock);
+
+    if ((ip = ifind(dev, inum)) != 0) {
+        release(&icache.lock);
+        kmem_cache_free(icache.cache, empty);
+        return ip;
     }
 
     ip = empty;
@@ -256,6 +512,17 @@ static struct inode* iget (uint dev, uint inum)
     ip->inum = inum;
     ip->ref = 1;
     ip->flags = 0;
+    ip->ralast = ip->rawin = ip->raend = 0;
+    ip->lastblk = 0;
+    ip->dcgen = 0;
+    ip->dirfree = 0;
+    ip->owner = 0;
+
+    h = ihash(dev, inum);
+    ip->hnext = icache.hash[h];
+    icache.hash[h] = ip;
+    icache.ninode++;
+    icache.misses++;
     release(&icache.lock);
 
     return ip;
@@ -288,6 +555,7 @@ void ilock (struct inode *ip)
     }
 
     ip->flags |= I_BUSY;
+    ip->owner = myproc();
     release(&icache.lock);
 
     if (!(ip->flags & I_VALID)) {
@@ -319,13 +587,20 @@ void iunlock (struct inode *ip)
 
     acquire(&icache.lock);
     ip->flags &= ~I_BUSY;
+    ip->owner = 0;
     wakeup(ip);
     release(&icache.lock);
 }
 
+// Whether the current process has locked ip. No lock: only the current
+// process could make it true, or false.
+int iholding (struct inode *ip)
+{
+    return (ip->flags & I_BUSY) && (ip->owner == myproc());
+}
+
 // Drop a reference to an in-memory inode.
-// If that was the last reference, the inode cache entry can
-// be recycled.
+// If that was the last reference, the inode cache entry is freed.
 // If that was the last reference and the inode has no links
 // to it, free the inode (and its content) on disk.
 void iput (struct inode *ip)
@@ -341,6 +616,11 @@ void iput (struct inode *ip)
         ip->flags |= I_BUSY;
         release(&icache.lock);
         itrunc(ip);
+
+        if (ip->type == T_DIR) {
+            dcache_purge(ip->dev, ip->inum);
+        }
+
         ip->type = 0;
         iupdate(ip);
 
@@ -349,8 +629,46 @@ void iput (struct inode *ip)
         wakeup(ip);
     }
 
-    ip->ref--;
+    if (--ip->ref > 0) {
+        release(&icache.lock);
+        return;
+    }
+
+    // the last reference. Free the entry if it is not valid (never
+    // read, or freed on disk above), otherwise keep it on the LRU list
+    // and free the least recently used one if there are too many.
+    if (!(ip->flags & I_VALID)) {
+        iunhash(ip);
+        release(&icache.lock);
+        kmem_cache_free(icache.cache, ip);
+        return;
+    }
+
+    ip->next = icache.lru.next;
+    ip->prev = &icache.lru;
+    icache.lru.next->prev = ip;
+    icache.lru.next = ip;
+
+    if (++icache.nunused <= NINODE) {
+        release(&icache.lock);
+        return;
+    }
+
+    ip = icache.lru.prev;
+    ip->prev->next = &icache.lru;
+    icache.lru.prev = ip->prev;
+    icache.nunused--;
+    iunhash(ip);
     release(&icache.lock);
+
+    kmem_cache_free(icache.cache, ip);
+}
+
+// Print the inode cache statistics. No lock, for debugging.
+void istat (void)
+{
+    cprintf("icache: %d inodes (%d unused), hits %d, misses %d\n",
+            icache.ninode, icache.nunused, icache.hits, icache.misses);
 }
 
 // Common idiom: unlock, then put.
@@ -368,16 +686,42 @@ void iunlockput (struct inode *ip)
 // are listed in ip->addrs[].  The next NINDIRECT blocks are
 // listed in block ip->addrs[NDIRECT].
 
+// Allocate a block for ip, right after the last one if possible, so
+// that the blocks of a file written sequentially are contiguous.
+static uint balloc_near (struct inode *ip)
+{
+    ip->lastblk = balloc(ip->dev, ip->lastblk ? ip->lastblk + 1 : 0);
+    return ip->lastblk;
+}
+
+// Return the address in entry n of the indirect block at addr,
+// allocating a block for it if necessary.
+static uint bmap_ind (struct inode *ip, uint addr, uint n)
+{
+    struct buf *bp;
+    uint *a;
+
+    bp = bread(ip->dev, addr);
+    a = (uint*) bp->data;
+
+    if ((addr = a[n]) == 0) {
+        a[n] = addr = balloc_near(ip);
+        log_write(bp);
+    }
+
+    brelse(bp);
+    return addr;
+}
+
 // Return the disk block address of the nth block in inode ip.
 // If there is no such block, bmap allocates one.
 static uint bmap (struct inode *ip, uint bn)
 {
-    uint addr, *a;
-    struct buf *bp;
+    uint addr;
 
     if (bn < NDIRECT) {
         if ((addr = ip->addrs[bn]) == 0) {
-            ip->addrs[bn] = addr = balloc(ip->dev);
+            ip->addrs[bn] = addr = balloc_near(ip);
         }
 
         return addr;
@@ -387,25 +731,55 @@ static uint bmap (struct inode *ip, uint bn)
 
     if (bn < NINDIRECT) {
         // Load indirect block, allocating if necessary.
-        if ((addr = ip->addrs[NDIRECT]) == 0) {
-            ip->addrs[NDIRECT] = addr = balloc(ip->dev);
+        if ((addr = ip->addrs[INDIRECT]) == 0) {
+            ip->addrs[INDIRECT] = addr = balloc_near(ip);
         }
 
-        bp = bread(ip->dev, addr);
-        a = (uint*) bp->data;
+        return bmap_ind(ip, addr, bn);
+    }
 
-        if ((addr = a[bn]) == 0) {
-            a[bn] = addr = balloc(ip->dev);
-            log_write(bp);
+    bn -= NINDIRECT;
+
+    if (bn < NDINDIRECT) {
+        // Load the double indirect block, then the indirect block
+        if ((addr = ip->addrs[DINDIRECT]) == 0) {
+            ip->addrs[DINDIRECT] = addr = balloc_near(ip);
         }
 
-        brelse(bp);
-        return addr;
+        addr = bmap_ind(ip, addr, bn / NINDIRECT);
+        return bmap_ind(ip, addr, bn % NINDIRECT);
     }
 
     panic("bmap: out of range");
 }
 
+// Free the indirect block at addr and the blocks it refers to, which are
+// indirect blocks themselves if level > 1.
+static void itrunc_ind (struct inode *ip, uint addr, int level)
+{
+    struct buf *bp;
+    uint *a;
+    int j;
+
+    bp = bread(ip->dev, addr);
+    a = (uint*) bp->data;
+
+    for (j = 0; j < NINDIRECT; j++) {
+        if (a[j] == 0) {
+            continue;
+        }
+
+        if (level > 1) {
+            itrunc_ind(ip, a[j], level - 1);
+        } else {
+            bfree(ip->dev, a[j]);
+        }
+    }
+
+    brelse(bp);
+    bfree(ip->dev, addr);
+}
+
 // Truncate inode (discard contents).
 // Only called when the inode has no links
 // to it (no directory entries referring to it)
@@ -413,9 +787,7 @@ static uint bmap (struct inode *ip, uint bn)
 // not an open file or current directory).
 static void itrunc (struct inode *ip)
 {
-    int i, j;
-    struct buf *bp;
-    uint *a;
+    int i;
 
     for (i = 0; i < NDIRECT; i++) {
         if (ip->addrs[i]) {
@@ -424,19 +796,14 @@ static void itrunc (struct inode *ip)
         }
     }
 
-    if (ip->addrs[NDIRECT]) {
-        bp = bread(ip->dev, ip->addrs[NDIRECT]);
-        a = (uint*) bp->data;
-
-        for (j = 0; j < NINDIRECT; j++) {
-            if (a[j]) {
-                bfree(ip->dev, a[j]);
-            }
-        }
+    if (ip->addrs[INDIRECT]) {
+        itrunc_ind(ip, ip->addrs[INDIRECT], 1);
+        ip->addrs[INDIRECT] = 0;
+    }
 
-        brelse(bp);
-        bfree(ip->dev, ip->addrs[NDIRECT]);
-        ip->addrs[NDIRECT] = 0;
+    if (ip->addrs[DINDIRECT]) {
+        itrunc_ind(ip, ip->addrs[DINDIRECT], 2);
+        ip->addrs[DINDIRECT] = 0;
     }
 
     ip->size = 0;
@@ -453,6 +820,73 @@ void stati (struct inode *ip, struct stat *st)
     st->size = ip->size;
 }
 
+// Read ahead for a read of blocks first to last. A read that starts in
+// (or right after) the block where the previous one ended is sequential,
+// and doubles the read-ahead window from RA_MIN up to RA_MAX blocks. The
+// next window is requested when half of the current one has been read,
+// so that the disk can merge it into a few commands, and the reads
+// overlap with the copy of the data to the caller.
+static void readahead (struct inode *ip, uint first, uint last)
+{
+    uint sectors[RA_MAX];
+    uint bn, end, nblk;
+    int n;
+
+    if ((first != ip->ralast) && (first != ip->ralast + 1)) {
+        ip->rawin = 0;          // random access
+        ip->raend = 0;
+        ip->ralast = last;
+        return;
+    }
+
+    if (last != ip->ralast || ip->rawin == 0) {
+        ip->rawin = (ip->rawin == 0) ? RA_MIN : ip->rawin * 2;
+
+        if (ip->rawin > RA_MAX) {
+            ip->rawin = RA_MAX;
+        }
+    }
+
+    ip->ralast = last;
+
+    if (ip->raend > last + 1 + ip->rawin / 2) {
+        return;
+    }
+
+    // the blocks within the size are all allocated, bmap does not write
+    nblk = (ip->size + BSIZE - 1) / BSIZE;
+    bn = (ip->raend > first + 1) ? ip->raend : first + 1;
+    end = last + 1 + ip->rawin;
+
+    if (end > nblk) {
+        end = nblk;
+    }
+
+    for (n = 0; bn < end && n < RA_MAX; bn++) {
+        sectors[n++] = bmap(ip, bn);
+    }
+
+    ip->raend = bn;
+    breada(ip->dev, sectors, n);
+}
+
+// Read ahead for a read of n bytes at off (by fileread). Only the
+// regular files are read ahead: the directory scans and the page-ins of
+// the executables (loadseg) read what they need and nothing more.
+// Caller holds the lock of ip.
+void ireadahead (struct inode *ip, uint off, uint n)
+{
+    if ((ip->type != T_FILE) || (off >= ip->size) || (n == 0)) {
+        return;
+    }
+
+    if (off + n > ip->size) {
+        n = ip->size - off;
+    }
+
+    readahead(ip, off / BSIZE, (off + n - 1) / BSIZE);
+}
+
 //PAGEBREAK!
 // Read data from inode.
 int readi (struct inode *ip, char *dst, uint off, uint n)
@@ -505,7 +939,8 @@ int writei (struct inode *ip, char *src, uint off, uint n)
         return -1;
     }
 
-    if (off + n > MAXFILE * BSIZE) {
+    // in blocks, MAXFILE * BSIZE may not fit in a uint
+    if (n > 0 && (off + n - 1) / BSIZE >= MAXFILE) {
         return -1;
     }
 
@@ -535,36 +970,80 @@ int namecmp (const char *s, const char *t)
 
 // Look for a directory entry in a directory.
 // If found, set *poff to byte offset of entry.
+// The name cache (dcache.c) is tried first. Otherwise the directory is
+// read, and all its entries are entered in the cache: the directory is
+// complete in the cache from then on (dp->dcgen), so the lookup of a
+// name that is not there does not read it either (creating files in a
+// big directory, or searching PATH).
 struct inode* dirlookup (struct inode *dp, char *name, uint *poff)
 {
-    uint off, inum;
-    struct dirent de;
+    struct dirent des[DIRCHUNK];
+    uint off, inum, doff, gen;
+    int i, n;
 
     if (dp->type != T_DIR) {
         panic("dirlookup not DIR");
     }
 
-    for (off = 0; off < dp->size; off += sizeof(de)) {
-        if (readi(dp, (char*) &de, off, sizeof(de)) != sizeof(de)) {
-            panic("dirlink read");
+    switch (dcache_lookup(dp->dev, dp->inum, name, &inum, &doff)) {
+    case 1:
+        if (poff) {
+            *poff = doff;
         }
 
-        if (de.inum == 0) {
-            continue;
+        return iget(dp->dev, inum);
+
+    case 0:
+        return 0;
+    }
+
+    if (dp->dcgen == dcache_gen()) {
+        return 0;
+    }
+
+    gen = dcache_gen();
+    inum = 0;
+
+    // enter the names read on the way, up to the one looked for
+    for (off = 0; off < dp->size && inum == 0; off += n) {
+        n = readi(dp, (char*) des, off, sizeof(des));
+
+        if (n <= 0 || n % sizeof(des[0]) != 0) {
+            panic("dirlookup read");
         }
 
-        if (namecmp(name, de.name) == 0) {
-            // entry matches path element
-            if (poff) {
-                *poff = off;
+        for (i = 0; i < n / sizeof(des[0]); i++) {
+            if (des[i].inum == 0) {
+                continue;
             }
 
-            inum = de.inum;
-            return iget(dp->dev, inum);
+            dcache_enter(dp->dev, dp->inum, des[i].name, des[i].inum,
+                         off + i * sizeof(des[0]));
+
+            if (namecmp(name, des[i].name) == 0) {
+                // entry matches path element
+                inum = des[i].inum;
+                doff = off + i * sizeof(des[0]);
+                break;
+            }
         }
     }
 
-    return 0;
+    if (inum == 0) {
+        // the whole directory has been entered
+        if (dcache_gen() == gen) {
+            dp->dcgen = gen;    // no entry of dp was recycled meanwhile
+        }
+
+        dcache_enter(dp->dev, dp->inum, name, 0, 0);
+        return 0;
+    }
+
+    if (poff) {
+        *poff = doff;
+    }
+
+    return iget(dp->dev, inum);
 }
 
 // Write a new directory entry (name, inum) into the directory dp.
@@ -580,8 +1059,8 @@ int dirlink (struct inode *dp, char *name, uint inum)
         return -1;
     }
 
-    // Look for an empty dirent.
-    for (off = 0; off < dp->size; off += sizeof(de)) {
+    // Look for an empty dirent, there is none before dp->dirfree.
+    for (off = dp->dirfree; off < dp->size; off += sizeof(de)) {
         if (readi(dp, (char*) &de, off, sizeof(de)) != sizeof(de)) {
             panic("dirlink read");
         }
@@ -598,9 +1077,30 @@ int dirlink (struct inode *dp, char *name, uint inum)
         panic("dirlink");
     }
 
+    dp->dirfree = off + sizeof(de);
+    dcache_enter(dp->dev, dp->inum, name, inum, off);
+
     return 0;
 }
 
+// Remove the directory entry name at offset off from the directory dp.
+void dirunlink (struct inode *dp, char *name, uint off)
+{
+    struct dirent de;
+
+    memset(&de, 0, sizeof(de));
+
+    if (writei(dp, (char*) &de, off, sizeof(de)) != sizeof(de)) {
+        panic("dirunlink: writei");
+    }
+
+    if (off < dp->dirfree) {
+        dp->dirfree = off;
+    }
+
+    dcache_enter(dp->dev, dp->inum, name, 0, 0);
+}
+
 //PAGEBREAK!
 // Paths
 
@@ -661,7 +1161,7 @@ static struct inode* namex (char *path, int nameiparent, char *name)
     if (*path == '/') {
         ip = iget(ROOTDEV, ROOTINO);
     } else {
-        ip = idup(proc->cwd);
+        ip = idup(myproc()->cwd);
     }
 
     while ((path = skipelem(path, name)) != 0) {
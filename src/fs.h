@@ -1,15 +1,25 @@
 // On-disk file system format.
 // Both the kernel and user programs use this header file.
 
-// Block 0 is unused.
-// Block 1 is super block.
+// The block size is chosen by mkfs (512 to 4096 bytes) and recorded in
+// the super block, which is at byte SBOFF of the disk whatever the block
+// size is. The layout, in blocks:
+// Block 0 is unused (but for the super block if the block size > 512).
+// Block 1 is super block (if the block size is 512, unused otherwise).
 // Blocks 2 through sb.ninodes/IPB hold inodes.
 // Then free bitmap blocks holding sb.size bits.
 // Then sb.nblocks data blocks.
 // Then sb.nlog log blocks.
 
 #define ROOTINO 1  // root i-number
-#define BSIZE 512  // block size
+#define SECTOR_SIZE 512  // disk sector size
+#define BSIZE_MIN 512
+#define BSIZE_MAX 4096
+#define BSIZE bsize  // block size, of the mounted file system
+#define SBOFF 512  // byte offset of the super block
+#define FSMAGIC 0x10203040
+
+extern uint bsize;
 
 // File system super block
 struct superblock {
@@ -17,11 +27,19 @@ struct superblock {
     uint    nblocks;        // Number of data blocks
     uint    ninodes;        // Number of inodes.
     uint    nlog;           // Number of log blocks
+    uint    bsize;          // Block size (bytes)
+    uint    magic;          // FSMAGIC
 };
 
-#define NDIRECT 12
+// addrs[] of an inode: NDIRECT direct blocks, then an indirect block
+// with NINDIRECT addresses, then a double indirect block (addresses of
+// NINDIRECT indirect blocks).
+#define NDIRECT 11
 #define NINDIRECT (BSIZE / sizeof(uint))
-#define MAXFILE (NDIRECT + NINDIRECT)
+#define NDINDIRECT (NINDIRECT * NINDIRECT)
+#define MAXFILE (NDIRECT + NINDIRECT + NDINDIRECT)
+#define INDIRECT    NDIRECT         // index of the indirect block in addrs
+#define DINDIRECT   (NDIRECT + 1)   // index of the double indirect block
 
 // On-disk inode structure
 struct dinode {
@@ -30,7 +48,7 @@ struct dinode {
     short   minor;          // Minor device number (T_DEV only)
     short   nlink;          // Number of links to inode in file system
     uint    size;           // Size of file (bytes)
-    uint    addrs[NDIRECT+1]; // Data block addresses
+    uint    addrs[NDIRECT+2]; // Data block addresses
 };
 
 // Inodes per block.
@@ -0,0 +1,214 @@
+// Block device: a queue of disk requests in front of the disk driver
+// (a SD card on the PL181, see device/pl181.c).
+//
+// iderw() queues a buffer and sleeps until the driver is done with it,
+// iderwv() queues several buffers before it sleeps, so that they can
+// be merged. iderw_async() does not wait at all (read ahead), the
+// buffers are released when done. The interrupt handler completes the
+// request in progress and starts the next one, the disk is never idle
+// while the queue is not empty.
+//
+// The queue is kept in elevator (C-SCAN) order: ascending sectors from
+// the position of the disk head, then from the lowest sector again.
+// The request to start is merged with the requests following it in
+// the queue for the next sectors in the same direction, up to MAXSECT
+// sectors, so a sequential run of buffers is one multiple block command.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "arm.h"
+#include "spinlock.h"
+#include "fs.h"
+#include "buf.h"
+
+#define MAXSECT     64      // sectors per command, the PL181 moves < 64KB
+#define SPB         (BSIZE / SECTOR_SIZE)   // sectors per block
+
+static struct {
+    struct spinlock lock;
+    struct buf      *queue;     // pending requests, in elevator order
+    struct buf      *run;       // the request in progress, linked by qnext
+    uint            pos;        // the block after the request in progress
+
+    // statistics
+    uint            nbuf;       // buffers transferred
+    uint            nreq;       // disk commands, each for a run of buffers
+} ide;
+
+static void ideintr (struct trapframe *tf, int idx);
+
+void ideinit (void)
+{
+    initlock(&ide.lock, "ide");
+
+    if (!sd_init(P2V(MMCI0))) {
+        panic("ideinit: no disk");
+    }
+
+    sd_enable_intr(ideintr);
+}
+
+// the distance from the disk head to block sector, in the sweep order
+static inline uint seekdist (uint sector)
+{
+    return sector - ide.pos;
+}
+
+// insert b into the queue in elevator order. Caller holds the lock.
+static void idequeue (struct buf *b)
+{
+    struct buf **pp;
+
+    for (pp = &ide.queue; *pp != NULL; pp = &(*pp)->qnext) {
+        if (seekdist((*pp)->sector) > seekdist(b->sector)) {
+            break;
+        }
+    }
+
+    b->qnext = *pp;
+    *pp = b;
+}
+
+// start the request at the head of the queue, merged with the requests
+// for the following blocks. Caller holds the lock, the disk is idle.
+static void idestart (void)
+{
+    struct buf *b, *last;
+    int n, write;
+
+    b = last = ide.queue;
+    write = (b->flags & B_DIRTY) != 0;
+    ide.queue = b->qnext;
+
+    for (n = 1; (n + 1) * SPB <= MAXSECT && ide.queue != NULL; n++) {
+        if ((ide.queue->sector != last->sector + 1) ||
+            (((ide.queue->flags & B_DIRTY) != 0) != write)) {
+            break;
+        }
+
+        last->qnext = ide.queue;
+        last = ide.queue;
+        ide.queue = ide.queue->qnext;
+    }
+
+    last->qnext = NULL;
+
+    ide.run = b;
+    ide.pos = last->sector + 1;
+    ide.nreq++;
+    ide.nbuf += n;
+
+    sd_start(b, b->sector * SPB, n * SPB, write);
+}
+
+// Interrupt handler.
+static void ideintr (struct trapframe *tf, int idx)
+{
+    struct buf *b, *next, *async;
+
+    async = NULL;
+    acquire(&ide.lock);
+
+    if (sd_intr()) {
+        for (b = ide.run; b != NULL; b = next) {
+            next = b->qnext;
+            b->flags |= B_VALID;
+            b->flags &= ~B_DIRTY;
+
+            if (b->flags & B_ASYNC) {
+                b->qnext = async;
+                async = b;
+            } else {
+                wakeup(b);
+            }
+        }
+
+        ide.run = NULL;
+
+        if (ide.queue != NULL) {
+            idestart();
+        }
+    }
+
+    release(&ide.lock);
+
+    // nobody waits for the async buffers, release them (not holding
+    // ide.lock, brelse takes the buffer cache locks)
+    for (b = async; b != NULL; b = next) {
+        next = b->qnext;
+        b->flags &= ~B_ASYNC;
+        brelse(b);
+    }
+}
+
+// queue bufs and start the disk if it is idle. Caller holds the lock.
+static void idesubmit (struct buf **bufs, int n)
+{
+    struct buf *b;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        b = bufs[i];
+
+        if (!(b->flags & B_BUSY)) {
+            panic("iderw: buf not busy");
+        }
+
+        if ((b->flags & (B_VALID | B_DIRTY)) == B_VALID) {
+            panic("iderw: nothing to do");
+        }
+
+        if (b->dev != ROOTDEV) {
+            panic("iderw: request not for disk 1");
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        idequeue(bufs[i]);
+    }
+
+    if ((ide.run == NULL) && (ide.queue != NULL)) {
+        idestart();
+    }
+}
+
+// Sync bufs with disk. For each of them:
+// If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
+// Else if B_VALID is not set, read buf from disk, set B_VALID.
+void iderwv (struct buf **bufs, int n)
+{
+    int i;
+
+    acquire(&ide.lock);
+    idesubmit(bufs, n);
+
+    for (i = 0; i < n; i++) {
+        while ((bufs[i]->flags & (B_VALID | B_DIRTY)) != B_VALID) {
+            sleep(bufs[i], &ide.lock);
+        }
+    }
+
+    release(&ide.lock);
+}
+
+void iderw (struct buf *b)
+{
+    iderwv(&b, 1);
+}
+
+// Start to sync bufs (marked B_ASYNC) with disk, do not wait.
+void iderw_async (struct buf **bufs, int n)
+{
+    acquire(&ide.lock);
+    idesubmit(bufs, n);
+    release(&ide.lock);
+}
+
+// Print the disk statistics. No lock, for debugging.
+void idestat (void)
+{
+    cprintf("ide: %d bufs in %d requests\n", ide.nbuf, ide.nreq);
+}
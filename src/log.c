@@ -1,6 +1,8 @@
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
 #include "spinlock.h"
 #include "fs.h"
 #include "buf.h"
@@ -8,73 +10,269 @@
 // Simple logging. Each system call that might write the file system
 // should be surrounded with begin_trans() and commit_trans() calls.
 //
-// The log holds at most one transaction at a time. Commit forces
-// the log (with commit record) to disk, then installs the affected
-// blocks to disk, then erases the log. begin_trans() ensures that
-// only one system call can be in a transaction; others must wait.
+// The system calls that write the file system join the running
+// transaction; the last one to leave it commits it for all of them
+// (group commit). A commit appends the blocks of the transaction to the
+// log as a record; a checkpoint installs all the logged blocks to their
+// home locations, in sector order, and the log starts over. Committed
+// blocks stay dirty in the buffer cache (which also keeps them there)
+// until the checkpoint, done:
+// * by the flusher kernel thread every FLUSHTICKS ticks, and by sync()
+//   (log_flush);
+// * by begin_trans() when the log, or the part of the buffer cache the
+//   logged blocks may pin, is full.
+// The system calls that wait for a commit to finish are let into the
+// next transaction together when it is done, so that they are committed
+// together too.
 //
-// Allowing only one transaction at a time means that the file
-// system code doesn't have to worry about the possibility of
-// one transaction reading a block that another one has modified,
-// for example an i-node block.
+// Durability: a system call that writes the file system is committed
+// before it returns, unless other system calls in its transaction are
+// still running. Then it is committed when the last of them returns,
+// and a crash before that loses it. fsync() waits for that commit.
+// Deferring the checkpoint loses nothing, as recovery installs the log.
+//
+// A commit or checkpoint waits for the system calls in the running
+// transaction to finish, and keeps new ones out until it is done, so
+// the file system code doesn't have to worry about a transaction
+// reading a block that another (uncommitted) one has modified, for
+// example an i-node block, and no block is written home before the
+// transaction that modified it is committed.
 //
 // Read-only system calls don't need to use transactions, though
 // this means that they may observe uncommitted data. I-node and
 // buffer locks prevent read-only calls from seeing inconsistent data.
 //
-// The log is a physical re-do log containing disk blocks.
-// The on-disk log format:
-//   header block, containing sector #s for block A, B, C, ...
+// The log is a physical re-do log containing disk blocks. Its size is
+// nlog blocks from the superblock (set by mkfs). It holds the records
+// committed since the last checkpoint, one after the other:
+//   header blocks: n, sequence #, checksum, sector #s for block A, B, ...
 //   block A
 //   block B
-//   block C
 //   ...
-// Log appends are synchronous.
-
-// Contents of the header block, used for both the on-disk header block
-// and to keep track in memory of logged sector #s before commit.
+//   header blocks of the next record
+//   ...
+// The header takes as many blocks as needed to describe the record. The
+// checksum covers the sequence #, the sector #s and the data blocks, so
+// a commit writes the header and the blocks in one sequential run, and
+// recovery only installs a record whose checksum is right. A torn commit
+// is thus ignored, like a commit that never happened. The sequence #
+// grows by one with each record, recovery installs the records from the
+// start of the log as long as they follow each other. The records left
+// over from before the last checkpoint have older sequence #s, so they
+// stop recovery. Installing a record again does no harm, so the log
+// need not be erased after a checkpoint. recover_test() checks this at
+// each boot, with records written for the purpose.
+
+#define LH_WORDS    (BSIZE / sizeof(uint))      // words in a header block
+#define LH_MAXCAP   (PTE_SZ / sizeof(int))      // the sector # arrays are a page at most
+#define LH_MAXBLKS  ((3 + LH_MAXCAP) * sizeof(uint) / BSIZE_MIN + 1)
+#define NBATCH      16  // blocks written at once, the disk merges them
+
+// The in-memory log header. The on-disk header is n, seq, cksum,
+// sector[] laid out word by word over the header blocks.
 struct logheader {
     int n;
-    int sector[LOGSIZE];
+    uint seq;
+    uint cksum;
+    int *sector;    // cap entries
 };
 
 struct log {
     struct spinlock lock;
     int start;
     int size;
-    int busy; // a transaction is active
+    int cap;            // sectors the log can hold (in one record or all)
+    int maxdirty;       // logged blocks pinned in the cache, at most
+    int used;           // log blocks taken by the committed records
+    uint seq;           // sequence # of the next record
+    int outstanding;    // system calls in the running transaction
+    int waiting;        // system calls sleeping in begin_trans()
+    int admitted;       // of them, let into the running transaction
+    int committing;     // in commit() or checkpoint(), wait
+    int forcing;        // waiting to commit, keep new system calls out
+    int ninstall;       // sectors logged since the last checkpoint
+    int *install;       // cap entries
+    uint nops;          // system calls that wrote the file system
+    uint ncommits;      // records committed
+    uint ncheckpoints;  // checkpoints
     int dev;
-    struct logheader lh;
+    struct logheader lh;    // the running transaction
 };
 struct log log;
 
 static void recover_from_log(void);
+static void recover_test(void);
+static void flusher(void);
 
 void initlog(void)
 {
     struct superblock sb;
-
-    if (sizeof(struct logheader) >= BSIZE) {
-        panic("initlog: too big logheader");
-    }
+    int nhdr;
 
     initlock(&log.lock, "log");
     readsb(ROOTDEV, &sb);
     log.start = sb.size - sb.nlog;
     log.size = sb.nlog;
     log.dev = ROOTDEV;
+
+    // a record that takes the whole log, with enough header blocks
+    for (nhdr = 1; nhdr < log.size; nhdr++) {
+        log.cap = log.size - nhdr;
+
+        if (3 + log.cap <= nhdr * LH_WORDS) {
+            break;
+        }
+    }
+
+    if (log.cap < MAXOPBLOCKS || log.cap > LH_MAXCAP) {
+        panic("initlog: bad log size");
+    }
+
+    // leave at least half of the buffer cache for the other blocks
+    log.maxdirty = UMAX(UMIN(log.cap, bcachesize() / 2), MAXOPBLOCKS);
+
+    log.lh.sector = kmalloc(get_order(log.cap * sizeof(int)));
+    log.install = kmalloc(get_order(log.cap * sizeof(int)));
+
+    if (log.lh.sector == 0 || log.install == 0) {
+        panic("initlog: no memory");
+    }
+
     recover_from_log();
+    recover_test();
+
+    kthread("flusher", flusher);
+}
+
+// Mix nwords words at p into checksum c
+static uint cksum(uint c, uint *p, int nwords)
+{
+    int i;
+
+    for (i = 0; i < nwords; i++) {
+        c = ((c << 7) | (c >> 25)) + p[i];
+    }
+
+    return c;
+}
+
+// Address of word w of the header in header block buffers bufs[]
+static uint* head_word(struct buf **bufs, int w)
+{
+    return (uint*)bufs[w / LH_WORDS]->data + w % LH_WORDS;
+}
+
+// Number of header blocks used by a header with n sectors
+static int head_blocks(int n)
+{
+    return (3 + n + LH_WORDS - 1) / LH_WORDS;
+}
+
+// Log blocks taken by a record of n blocks
+static int rec_blocks(int n)
+{
+    return head_blocks(n) + n;
+}
+
+// Read the header of the record at block off of the log into the
+// in-memory log header. Return 0 if it cannot be a record.
+static int read_head(int off)
+{
+    struct buf *bufs[LH_MAXBLKS];
+    int i, nb;
+
+    bufs[0] = bread(log.dev, log.start + off);
+    log.lh.n = *head_word(bufs, 0);
+    log.lh.seq = *head_word(bufs, 1);
+    log.lh.cksum = *head_word(bufs, 2);
+
+    if (log.lh.n <= 0 || log.lh.n > log.cap ||
+        off + rec_blocks(log.lh.n) > log.size) {
+        brelse(bufs[0]);
+        log.lh.n = 0;      // garbage, or the end of the log
+        return 0;
+    }
+
+    nb = head_blocks(log.lh.n);
+
+    for (i = 1; i < nb; i++) {
+        bufs[i] = bread(log.dev, log.start + off + i);
+    }
+
+    for (i = 0; i < log.lh.n; i++) {
+        log.lh.sector[i] = *head_word(bufs, 3 + i);
+    }
+
+    for (i = 0; i < nb; i++) {
+        brelse(bufs[i]);
+    }
+
+    return 1;
+}
+
+// Write in-memory log header to disk, at block off of the log.
+static void write_head(int off)
+{
+    struct buf *bufs[LH_MAXBLKS];
+    int i, nb;
+
+    nb = head_blocks(log.lh.n);
+
+    for (i = 0; i < nb; i++) {
+        bufs[i] = bread(log.dev, log.start + off + i);
+    }
+
+    *head_word(bufs, 0) = log.lh.n;
+    *head_word(bufs, 1) = log.lh.seq;
+    *head_word(bufs, 2) = log.lh.cksum;
+
+    for (i = 0; i < log.lh.n; i++) {
+        *head_word(bufs, 3 + i) = log.lh.sector[i];
+    }
+
+    for (i = 0; i < nb; i++) {
+        bwrite(bufs[i]);
+        brelse(bufs[i]);
+    }
 }
 
-// Copy committed blocks from log to their home location
-static void install_trans(void)
+// Checksum of the header fields but the checksum itself
+static uint head_cksum(void)
+{
+    uint c;
+
+    c = cksum(log.lh.seq, (uint*)&log.lh.n, 1);
+    return cksum(c, (uint*)log.lh.sector, log.lh.n);
+}
+
+// Checksum of the record at block off of the log, read from disk
+static uint log_cksum(int off)
+{
+    struct buf *lbuf;
+    uint c;
+    int tail;
+
+    c = head_cksum();
+
+    for (tail = 0; tail < log.lh.n; tail++) {
+        lbuf = bread(log.dev, log.start + off + head_blocks(log.lh.n) + tail);
+        c = cksum(c, (uint*)lbuf->data, LH_WORDS);
+        brelse(lbuf);
+    }
+
+    return c;
+}
+
+// Copy the blocks of the record at block off of the log to their home
+// location (recovery)
+static void install_trans(int off)
 {
     int tail;
     struct buf *lbuf;
     struct buf *dbuf;
 
     for (tail = 0; tail < log.lh.n; tail++) {
-        lbuf = bread(log.dev, log.start+tail+1); // read log block
+        lbuf = bread(log.dev, log.start + off + head_blocks(log.lh.n) + tail);
         dbuf = bread(log.dev, log.lh.sector[tail]); // read dst
 
         memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
@@ -85,84 +283,445 @@ static void install_trans(void)
     }
 }
 
-// Read the log header from disk into the in-memory log header
-static void read_head(void)
+// Install the records from the start of the log, as long as they are
+// complete and follow each other.
+static void recover_from_log(void)
 {
-    struct buf *buf;
-    struct logheader *lh;
-    int i;
+    int off, n;
+    uint seq;
 
-    buf = bread(log.dev, log.start);
-    lh = (struct logheader *) (buf->data);
-    log.lh.n = lh->n;
+    off = n = 0;
+    seq = 0;
 
-    for (i = 0; i < log.lh.n; i++) {
-        log.lh.sector[i] = lh->sector[i];
+    while (off < log.size && read_head(off)) {
+        if ((n > 0 && log.lh.seq != seq + 1) || log_cksum(off) != log.lh.cksum) {
+            break;
+        }
+
+        install_trans(off);
+
+        seq = log.lh.seq;
+        off += rec_blocks(log.lh.n);
+        n++;
     }
 
-    brelse(buf);
+    // the next record must not follow any record left in the log
+    log.seq = ((n > 0) && (seq > log.lh.seq) ? seq : log.lh.seq) + 1;
+    log.lh.n = 0;
 }
 
-// Write in-memory log header to disk.
-// This is the true point at which the
-// current transaction commits.
-static void write_head(void)
+// Write a record of two blocks at block off of the log, to install value
+// v in sectors s0 and s1, with a wrong checksum if torn. Return the block
+// after the record.
+static int test_record(int off, uint seq, int s0, int s1, uint v, int torn)
 {
-    struct buf *buf;
-    struct logheader *hb;
+    struct buf *b;
     int i;
 
-    buf = bread(log.dev, log.start);
-    hb = (struct logheader *) (buf->data);
+    log.lh.n = 2;
+    log.lh.seq = seq;
+    log.lh.sector[0] = s0;
+    log.lh.sector[1] = s1;
+    log.lh.cksum = head_cksum();
+
+    for (i = 0; i < 2; i++) {
+        b = bread(log.dev, log.start + off + head_blocks(2) + i);
+        memset(b->data, 0, BSIZE);
+        *(uint*)b->data = v;
+        log.lh.cksum = cksum(log.lh.cksum, (uint*)b->data, LH_WORDS);
+        bwrite(b);
+        brelse(b);
+    }
 
-    hb->n = log.lh.n;
+    if (torn) {
+        log.lh.cksum++;
+    }
 
-    for (i = 0; i < log.lh.n; i++) {
-        hb->sector[i] = log.lh.sector[i];
+    write_head(off);
+    return off + rec_blocks(2);
+}
+
+// Set (if set) and return the first word of sector s
+static uint test_home(int s, int set, uint v)
+{
+    struct buf *b;
+
+    b = bread(log.dev, s);
+
+    if (set) {
+        memset(b->data, 0, BSIZE);
+        *(uint*)b->data = v;
+        bwrite(b);
     }
 
-    bwrite(buf);
-    brelse(buf);
+    v = *(uint*)b->data;
+    brelse(b);
+
+    return v;
 }
 
-static void recover_from_log(void)
+// Check the recovery of several records at boot. The log is free after
+// recover_from_log() until the first commit, so the records are written
+// at its start, and their home sectors are the last blocks of the log.
+// Recovery must install the records that follow each other, and stop
+// at a torn record, or at one older than the record before it.
+static void recover_test(void)
 {
-    read_head();
-    install_trans(); // if committed, copy from log to disk
+    int h[5], i, off;
+    uint seq;
+
+    if (log.size < 4 * rec_blocks(2) + 5) {
+        return;
+    }
+
+    for (i = 0; i < 5; i++) {
+        h[i] = log.start + log.size - 5 + i;
+        test_home(h[i], 1, 0);
+    }
+
+    // two records, a torn one, then one that would follow it
+    seq = log.seq;
+    off = test_record(0, seq, h[0], h[1], 1, 0);
+    off = test_record(off, seq + 1, h[1], h[2], 2, 0);
+    off = test_record(off, seq + 2, h[3], h[4], 3, 1);
+    test_record(off, seq + 3, h[3], h[4], 4, 0);
+
+    recover_from_log();
+
+    if (test_home(h[0], 0, 0) != 1 || test_home(h[1], 0, 0) != 2 ||
+        test_home(h[2], 0, 0) != 2 || test_home(h[3], 0, 0) != 0 ||
+        test_home(h[4], 0, 0) != 0) {
+        panic("recover_test: torn record");
+    }
+
+    // a record left over from before a checkpoint follows a new one
+    for (i = 0; i < 5; i++) {
+        test_home(h[i], 1, 0);
+    }
+
+    off = test_record(0, seq + 10, h[0], h[1], 5, 0);
+    test_record(off, seq + 9, h[2], h[3], 6, 0);
+
+    recover_from_log();
+
+    if (test_home(h[0], 0, 0) != 5 || test_home(h[1], 0, 0) != 5 ||
+        test_home(h[2], 0, 0) != 0 || test_home(h[3], 0, 0) != 0) {
+        panic("recover_test: old record");
+    }
+
+    // the next commit must not follow any of these records
+    log.seq = seq + 11;
     log.lh.n = 0;
-    write_head(); // clear the log
 }
 
-void begin_trans(void)
+// Append the running transaction to the log: the header, then the
+// blocks from the cache, one sequential run. The checksum (computed the
+// same way as log_cksum) tells recovery whether the run was completed.
+static void write_log(void)
+{
+    int tail, i, n, off;
+    struct buf *lbufs[NBATCH];
+    struct buf *dbuf;
+
+    log.lh.seq = log.seq;
+    log.lh.cksum = head_cksum();
+
+    for (tail = 0; tail < log.lh.n; tail++) {
+        dbuf = bread(log.dev, log.lh.sector[tail]); // cached and dirty
+        log.lh.cksum = cksum(log.lh.cksum, (uint*)dbuf->data, LH_WORDS);
+        brelse(dbuf);
+    }
+
+    write_head(log.used);
+    off = log.used + head_blocks(log.lh.n);
+
+    for (tail = 0; tail < log.lh.n; tail += n) {
+        n = log.lh.n - tail;
+
+        if (n > NBATCH) {
+            n = NBATCH;
+        }
+
+        for (i = 0; i < n; i++) {
+            lbufs[i] = bread(log.dev, log.start + off + tail + i);
+            dbuf = bread(log.dev, log.lh.sector[tail + i]);
+            memmove(lbufs[i]->data, dbuf->data, BSIZE);
+            brelse(dbuf);
+        }
+
+        bwritev(lbufs, n);
+
+        for (i = 0; i < n; i++) {
+            brelse(lbufs[i]);
+        }
+    }
+}
+
+// Commit the running transaction (all its system calls have finished):
+// append it to the log, and add its sectors to those to install. Called
+// with log.committing set.
+static void commit(void)
 {
+    int i, j;
+
+    if (log.lh.n == 0) {
+        return;
+    }
+
+    write_log();     // Write header and blocks -- the real commit
+
+    for (i = 0; i < log.lh.n; i++) {
+        for (j = 0; j < log.ninstall; j++) {
+            if (log.install[j] == log.lh.sector[i]) {
+                break;
+            }
+        }
+
+        if (j == log.ninstall) {
+            log.install[log.ninstall++] = log.lh.sector[i];
+        }
+    }
+
     acquire(&log.lock);
+    log.used += rec_blocks(log.lh.n);
+    log.seq++;
+    log.ncommits++;
+    log.lh.n = 0;
+    release(&log.lock);
+}
+
+// Install the committed blocks from the cache to the home locations in
+// sector order, and start the log over. Called with log.committing set
+// (after commit), so nobody modifies the blocks meanwhile.
+static void checkpoint(void)
+{
+    int i, j, n, s;
+    struct buf *b;
+    struct buf *bufs[NBATCH];
+
+    // insertion sort
+    for (i = 1; i < log.ninstall; i++) {
+        s = log.install[i];
 
-    while (log.busy) {
+        for (j = i; j > 0 && log.install[j-1] > s; j--) {
+            log.install[j] = log.install[j-1];
+        }
+
+        log.install[j] = s;
+    }
+
+    for (i = 0; i < log.ninstall; i += NBATCH) {
+        n = 0;
+
+        for (j = i; j < log.ninstall && j < i + NBATCH; j++) {
+            b = bread(log.dev, log.install[j]);
+
+            if (b->flags & B_DIRTY) {
+                bufs[n++] = b;
+            } else {
+                brelse(b);
+            }
+        }
+
+        bwritev(bufs, n);
+
+        for (j = 0; j < n; j++) {
+            brelse(bufs[j]);
+        }
+    }
+
+    acquire(&log.lock);
+
+    if (log.ninstall > 0) {
+        log.ncheckpoints++;
+    }
+
+    log.ninstall = 0;
+    log.used = 0;
+    release(&log.lock);
+}
+
+// Whether the log can take n more blocks in the running transaction:
+// room for its record in the log, and for its blocks in the cache.
+static int log_fits(int n)
+{
+    n += log.lh.n;
+
+    return (log.used + rec_blocks(n) <= log.size) && (log.ninstall + n <= log.cap) &&
+           (log.ninstall + n <= log.maxdirty);
+}
+
+// Commit the running transaction and, if install, checkpoint. Waits for
+// the system calls in the transaction to finish, and keeps new ones out
+// meanwhile. Called and returns with log.lock held.
+static void flush(int install)
+{
+    log.forcing++;
+
+    while (log.outstanding > 0 || log.committing) {
         sleep(&log, &log.lock);
     }
 
-    log.busy = 1;
+    log.forcing--;
+    log.committing = 1;
+    release(&log.lock);
+
+    commit();
+
+    if (install) {
+        checkpoint();
+    }
+
+    acquire(&log.lock);
+    log.committing = 0;
+
+    // let in the system calls that waited meanwhile, as many as fit, so
+    // that they make the next group
+    while (log.waiting > log.admitted && !log.forcing &&
+           log_fits((log.outstanding + 1) * MAXOPBLOCKS)) {
+        log.outstanding++;
+        log.admitted++;
+    }
+
+    wakeup(&log);
+}
+
+// Wait in begin_trans() for the running transaction to change. Return
+// 1 if flush() let us into it meanwhile (log.outstanding counts us).
+static int trans_wait(void)
+{
+    log.waiting++;
+    sleep(&log, &log.lock);
+    log.waiting--;
+
+    if (log.admitted > 0) {
+        log.admitted--;
+        return 1;
+    }
+
+    return 0;
+}
+
+// Join the running transaction. Called at the start of each system call
+// that writes the file system.
+void begin_trans(void)
+{
+    acquire(&log.lock);
+
+    for (;;) {
+        if (log.committing || log.forcing) {
+            if (trans_wait()) {
+                break;
+            }
+
+        } else if (!log_fits((log.outstanding + 1) * MAXOPBLOCKS)) {
+            // the system calls in the transaction reserved MAXOPBLOCKS
+            // each, they might have used less. Once they are done, the
+            // log is full indeed: install it.
+            if (log.outstanding > 0) {
+                if (trans_wait()) {
+                    break;
+                }
+            } else {
+                flush(1);
+            }
+
+        } else {
+            log.outstanding++;
+            break;
+        }
+    }
+
+    log.nops++;
     release(&log.lock);
 }
 
+// Leave the running transaction. The last system call to leave commits
+// it, for all the system calls that took part.
 void commit_trans(void)
 {
+    acquire(&log.lock);
+
+    if (log.committing) {
+        panic("commit_trans: committing");
+    }
+
+    log.outstanding--;
+
+    if (log.outstanding == 0 && log.lh.n > 0) {
+        flush(0);
+    }
+
+    // flush() or begin_trans() may be waiting for us
+    wakeup(&log);
+    release(&log.lock);
+}
+
+// Make the system calls that have finished durable: commit the running
+// transaction, after the system calls still in it (for fsync).
+void log_commit(void)
+{
+    acquire(&log.lock);
+
     if (log.lh.n > 0) {
-        write_head();    // Write header to disk -- the real commit
-        install_trans(); // Now install writes to home locations
-        log.lh.n = 0;
-        write_head();    // Erase the transaction from the log
+        flush(0);
     }
 
+    release(&log.lock);
+}
+
+// Commit the running transaction and install the log (for sync, and
+// the flusher).
+void log_flush(void)
+{
     acquire(&log.lock);
-    log.busy = 0;
-    wakeup(&log);
+    flush(1);
     release(&log.lock);
 }
 
+// The flusher kernel thread: checkpoint every FLUSHTICKS ticks, if there
+// is anything to install.
+static void flusher(void)
+{
+    uint ticks0;
+    int dirty;
+
+    for (;;) {
+        acquire(&tickslock);
+        ticks0 = ticks;
+
+        while (ticks - ticks0 < FLUSHTICKS) {
+            sleep(&ticks, &tickslock);
+        }
+
+        release(&tickslock);
+
+        acquire(&log.lock);
+        dirty = (log.lh.n > 0) || (log.ninstall > 0);
+        release(&log.lock);
+
+        if (dirty) {
+            log_flush();
+        }
+    }
+}
+
+// Number of records committed so far
+int log_ncommits(void)
+{
+    return log.ncommits;
+}
+
+// Print the log statistics. No lock, for debugging.
+void logstat(void)
+{
+    cprintf("log: %d blocks, %d in use, %d ops in %d commits, %d checkpoints\n",
+            log.size, log.used, log.nops, log.ncommits, log.ncheckpoints);
+}
+
 // Caller has modified b->data and is done with the buffer.
-// Append the block to the log and record the block number,
-// but don't write the log header (which would commit the write).
+// Record the block number in the log (the block is written to the
+// log at commit).
 // log_write() replaces bwrite(); a typical use is:
 //   bp = bread(...)
 //   modify bp->data[]
@@ -170,14 +729,15 @@ void commit_trans(void)
 //   brelse(bp)
 void log_write(struct buf *b)
 {
-    struct buf *lbuf;
     int i;
 
-    if (log.lh.n >= LOGSIZE || log.lh.n >= log.size - 1) {
+    acquire(&log.lock);
+
+    if (log.lh.n >= log.cap) {
         panic("too big a transaction");
     }
 
-    if (!log.busy) {
+    if (log.outstanding < 1) {
         panic("write outside of trans");
     }
 
@@ -188,17 +748,15 @@ void log_write(struct buf *b)
     }
 
     log.lh.sector[i] = b->sector;
-    lbuf = bread(b->dev, log.start+i+1);
-
-    memmove(lbuf->data, b->data, BSIZE);
-    bwrite(lbuf);
-    brelse(lbuf);
 
     if (i == log.lh.n) {
         log.lh.n++;
     }
 
-    b->flags |= B_DIRTY; // XXX prevent eviction
+    // the block is copied to the log at commit, and written to its home
+    // location at checkpoint. A dirty buffer is never evicted.
+    b->flags |= B_DIRTY;
+    release(&log.lock);
 }
 
 //PAGEBREAK!
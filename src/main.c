@@ -10,15 +10,38 @@
 extern void* end;
 
 struct cpu	cpus[NCPU];
-struct cpu	*cpu;
+int		ncpu;
 
 #define MB (1024*1024)
 
+// Set up the per-CPU state of the CPU we are running on
+static void cpuinit (int id)
+{
+    struct cpu *c;
+
+    c = &cpus[id];
+    c->id = id;
+
+    // mycpu() reads it back from TPIDRPRW
+    asm("MCR p15, 0, %[v], c13, c0, 4": :[v]"r" (c):);
+}
+
+// Run the processes on this CPU
+static void mpmain (void)
+{
+    cprintf("cpu%d: starting\n", mycpu()->id);
+    mycpu()->started = 1;
+    scheduler();
+}
+
 void kmain (void)
 {
     uint vectbl;
 
-    cpu = &cpus[0];
+    cpuinit(0);
+    // the VersatilePB has one ARM1176. The spinlocks and the per-CPU
+    // state are ready for more, but no secondary CPU is ever started.
+    ncpu = 1;
 
     uart_init (P2V(UART0));
 
@@ -33,22 +56,27 @@ void kmain (void)
     
     kmem_init ();
     kmem_init2(P2V(INIT_KERNMAP), P2V(PHYSTOP));
+    slabinit ();
     
     trap_init ();				// vector table and stacks for models
     pic_init (P2V(VIC_BASE));	// interrupt controller
-    uart_enable_rx ();			// interrupt for uart
+    uart_enable_intr ();		// interrupts for uart
     consoleinit ();				// console
     pinit ();					// process (locks)
 
-    binit ();					// buffer cache
     fileinit ();				// file table
+    pipeinit ();				// pipe cache
     iinit ();					// inode cache
-    ideinit ();					// ide (memory block device)
+    ideinit ();					// disk (SD card)
     timer_init (HZ);			// the timer (ticker)
 
+    // the ticks first, then the disk, then the console
+    pic_setprio (PIC_TIMER01, 0);
+    pic_setprio (PIC_MMCI0, 1);
+    pic_setprio (PIC_UART0, 2);
 
     sti ();
 
     userinit();					// first user process
-    scheduler();				// start running processes
+    mpmain();					// start running processes
 }
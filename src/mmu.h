@@ -29,6 +29,11 @@
 
 #define PE_CACHE    (1 << 3)// cachable
 #define PE_BUF      (1 << 2)// bufferable
+#define PTE_APX     (1 << 9)// with AP_KUR: read-only for both kernel and user
+
+// A copy-on-write page is mapped read-only (PTE_APX and AP_KUR). All the
+// other user pages are mapped AP_KU (or AP_KO for the stack guard page).
+#define PTE_COW(pte) (((pte) & PTE_APX) && (PTE_AP(pte) == AP_KUR))
 
 #define PE_TYPES    0x03    // mask for page type
 #define KPDE_TYPE   0x02    // use "section" type for kernel page directory
@@ -60,4 +65,12 @@
 #define PT_ADDR(v)  align_dn(v, PT_SZ)              // physical address of the PT
 #define PT_ORDER    10
 
+// fault status register (DFSR/IFSR) and the fault status
+#define FSR_WNR     (1 << 11)           // data abort caused by a write
+#define FSR_FS(fsr) (((fsr) & 0x0F) | (((fsr) >> 6) & 0x10))
+#define FS_TRANS_SEC    0x05            // translation fault (section)
+#define FS_TRANS_PAGE   0x07            // translation fault (page)
+#define FS_PERM_SEC     0x0D            // permission fault (section)
+#define FS_PERM_PAGE    0x0F            // permission fault (page)
+
 #endif
\ No newline at end of file
@@ -3,18 +3,27 @@
 
 
 #define NPROC        64  // maximum number of processes
+#define NPRIO         8  // number of scheduling priorities (0 is the highest)
+#define NSLEEPQ      64  // number of hashed sleep queues (power of 2)
 #define KSTACKSIZE 4096  // size of per-process kernel stack
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
-#define NBUF         10  // size of disk block cache
-#define NINODE       50  // maximum number of active i-nodes
+#define NBUF_MIN     (MAXOPBLOCKS*2)  // minimum size of disk block cache (the log may pin half)
+#define BCACHE_SHARE 64  // disk block cache uses 1/BCACHE_SHARE of memory
+#define NINODE      200  // maximum number of unused i-nodes kept cached
+#define NDENTRY    1024  // maximum number of name cache entries
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
-#define LOGSIZE      10  // max data sectors in on-disk log
+#define NSEG          4  // max loadable segments of a program
+#define MAXOPBLOCKS  32  // max # of blocks any FS op writes
+#define LOGSIZE      (MAXOPBLOCKS*3)  // data sectors in the on-disk log made by mkfs
 
-#define HZ           10
+#define HZ          100  // timer interrupts per second
+#define QUANTUM       2  // time slice at the highest priority (in timer ticks)
+#define BOOSTTICKS  100  // reset all processes to their base priority this often
+#define FLUSHTICKS  500  // commit and install the log this often
 
 #define N_CALLSTK    15
 #endif
\ No newline at end of file
@@ -1,23 +1,83 @@
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
 #include "fs.h"
 #include "file.h"
 #include "spinlock.h"
 
-#define PIPESIZE 512
+// The data of a pipe are a ring of npages pages (a power of 2, so that
+// the byte counters can wrap around). The reader and the writer copy
+// whole runs of bytes, up to the end of a page, with memmove. A reader
+// sleeping on an empty pipe is woken when data arrive, a writer sleeping
+// on a full pipe when space is freed, not on every read or write.
+// fcntl(F_SETPIPE_SZ) changes the size of a pipe, up to PIPEMAXPG pages.
+//
+// splice() moves data between a pipe and a file with a single copy, the
+// file reads or writes the ring directly (for an inode, out of the
+// buffer cache). The file may sleep on the disk, so the copy is done
+// without the pipe lock: wsplice (rsplice) reserves the write (read) end
+// meanwhile, keeping the other writers (readers) and piperesize away.
+// sys_splice only accepts regular files, which never wait for input,
+// so the reservation is always short.
+
+#define PIPEPG      1       // pages of a new pipe
+#define PIPEMAXPG   16      // pages of the largest pipe
 
 struct pipe {
     struct spinlock lock;
-    char data[PIPESIZE];
+    char *pages[PIPEMAXPG];
+    uint size;      // npages * PTE_SZ
+    uint npages;
     uint nread;     // number of bytes read
     uint nwrite;    // number of bytes written
     int readopen;   // read fd is still open
     int writeopen;  // write fd is still open
+    int wsplice;    // a splice is writing into the ring
+    int rsplice;    // a splice is reading from the ring
 };
 
+static struct kmem_cache *pipecache;
+
+// the lock is initialized once, a free pipe has it released
+static void pipector(void *v)
+{
+    initlock(&((struct pipe*)v)->lock, "pipe");
+}
+
+void pipeinit(void)
+{
+    if((pipecache = kmem_cache_create("pipe", sizeof(struct pipe), pipector)) == 0) {
+        panic("pipeinit");
+    }
+}
+
+static void freepages(char **pages, int n)
+{
+    int i;
+
+    for(i = 0; i < n; i++) {
+        free_page(pages[i]);
+    }
+}
+
+// allocate n pages, return 0 if out of memory
+static int allocpages(char **pages, int n)
+{
+    int i;
+
+    for(i = 0; i < n; i++) {
+        if((pages[i] = alloc_page()) == 0) {
+            freepages(pages, i);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
 int pipealloc(struct file **f0, struct file **f1)
 {
     struct pipe *p;
@@ -29,16 +89,18 @@ int pipealloc(struct file **f0, struct file **f1)
         goto bad;
     }
 
-    if((p = kmalloc (get_order(sizeof(*p)))) == 0) {
+    if((p = kmem_cache_alloc(pipecache)) == 0 || allocpages(p->pages, PIPEPG) < 0) {
         goto bad;
     }
 
+    p->npages = PIPEPG;
+    p->size = PIPEPG * PTE_SZ;
     p->readopen = 1;
     p->writeopen = 1;
     p->nwrite = 0;
     p->nread = 0;
-
-    initlock(&p->lock, "pipe");
+    p->wsplice = 0;
+    p->rsplice = 0;
 
     (*f0)->type = FD_PIPE;
     (*f0)->readable = 1;
@@ -54,7 +116,7 @@ int pipealloc(struct file **f0, struct file **f1)
     //PAGEBREAK: 20
     bad:
     if(p) {
-        kfree (p, get_order(sizeof*p));
+        kmem_cache_free(pipecache, p);
     }
 
     if(*f0) {
@@ -83,47 +145,150 @@ void pipeclose(struct pipe *p, int writable)
 
     if(p->readopen == 0 && p->writeopen == 0){
         release(&p->lock);
-        kfree (p, get_order(sizeof(*p)));
+        freepages(p->pages, p->npages);
+        kmem_cache_free(pipecache, p);
 
     } else {
         release(&p->lock);
     }
 }
 
+// the address of byte pos in the ring, and the number of bytes
+// from there to the end of its page
+static char* pipeaddr(struct pipe *p, uint pos, uint *len)
+{
+    pos &= p->size - 1;
+    *len = PTE_SZ - pos % PTE_SZ;
+
+    return p->pages[pos / PTE_SZ] + pos % PTE_SZ;
+}
+
+// The size of the pipe in bytes.
+int pipesize(struct pipe *p)
+{
+    return p->size;
+}
+
+// Change the size of the pipe to at least n bytes, rounded up to a
+// power of 2 pages. Fail if the data in the pipe do not fit. Return
+// the new size.
+int piperesize(struct pipe *p, int n)
+{
+    char *pages[PIPEMAXPG], *old[PIPEMAXPG];
+    char *src;
+    uint npages, nold, pos, len, i;
+
+    if(n <= 0 || n > PIPEMAXPG * PTE_SZ) {
+        return -1;
+    }
+
+    for(npages = 1; npages * PTE_SZ < n; npages <<= 1)
+        ;
+
+    if(allocpages(pages, npages) < 0) {
+        return -1;
+    }
+
+    acquire(&p->lock);
+
+    while(p->wsplice || p->rsplice) {
+        sleep(p->wsplice ? &p->nwrite : &p->nread, &p->lock);
+    }
+
+    if(p->nwrite - p->nread > npages * PTE_SZ) {
+        release(&p->lock);
+        freepages(pages, npages);
+        return -1;
+    }
+
+    // copy the data to the beginning of the new ring
+    i = 0;
+
+    for(pos = p->nread; pos != p->nwrite; pos += len){
+        src = pipeaddr(p, pos, &len);
+
+        if(len > p->nwrite - pos) {
+            len = p->nwrite - pos;
+        }
+
+        if(len > PTE_SZ - i % PTE_SZ) {
+            len = PTE_SZ - i % PTE_SZ;
+        }
+
+        memmove(pages[i / PTE_SZ] + i % PTE_SZ, src, len);
+        i += len;
+    }
+
+    nold = p->npages;
+    memmove(old, p->pages, sizeof(old));
+    memmove(p->pages, pages, sizeof(pages));
+
+    p->npages = npages;
+    p->size = npages * PTE_SZ;
+    p->nread = 0;
+    p->nwrite = i;
+
+    // a writer may have room now
+    wakeup(&p->nwrite);
+    release(&p->lock);
+
+    freepages(old, nold);
+    return p->size;
+}
+
 //PAGEBREAK: 40
 int pipewrite(struct pipe *p, char *addr, int n)
 {
+    char *dst;
+    uint len;
     int i;
 
     acquire(&p->lock);
 
-    for(i = 0; i < n; i++){
-        while(p->nwrite == p->nread + PIPESIZE){  //DOC: pipewrite-full
-            if(p->readopen == 0 /*|| proc->killed*/){
+    for(i = 0; i < n; i += len){
+        while(p->nwrite == p->nread + p->size || p->wsplice){  //DOC: pipewrite-full
+            if(p->readopen == 0 /*|| myproc()->killed*/){
                 release(&p->lock);
                 return -1;
             }
 
-            wakeup(&p->nread);
             sleep(&p->nwrite, &p->lock);  //DOC: pipewrite-sleep
         }
 
-        p->data[p->nwrite++ % PIPESIZE] = addr[i];
+        dst = pipeaddr(p, p->nwrite, &len);
+
+        if(len > p->nread + p->size - p->nwrite) {
+            len = p->nread + p->size - p->nwrite;
+        }
+
+        if(len > n - i) {
+            len = n - i;
+        }
+
+        memmove(dst, addr + i, len);
+
+        // wake up the reader only if the pipe was empty
+        if(p->nwrite == p->nread) {
+            wakeup(&p->nread);  //DOC: pipewrite-wakeup1
+        }
+
+        p->nwrite += len;
     }
 
-    wakeup(&p->nread);  //DOC: pipewrite-wakeup1
     release(&p->lock);
     return n;
 }
 
 int piperead(struct pipe *p, char *addr, int n)
 {
+    char *src;
+    uint len;
     int i;
 
     acquire(&p->lock);
 
-    while(p->nread == p->nwrite && p->writeopen){  //DOC: pipe-empty
-        if(proc->killed){
+    while((p->nread == p->nwrite && p->writeopen) || p->rsplice){  //DOC: pipe-empty
+        if(myproc()->killed){
             release(&p->lock);
             return -1;
         }
@@ -131,16 +296,147 @@ int piperead(struct pipe *p, char *addr, int n)
         sleep(&p->nread, &p->lock); //DOC: piperead-sleep*/
     }
 
-    for(i = 0; i < n; i++){  //DOC: piperead-copy
-        if(p->nread == p->nwrite) {
-            break;
+    for(i = 0; i < n && p->nread != p->nwrite; i += len){  //DOC: piperead-copy
+        src = pipeaddr(p, p->nread, &len);
+
+        if(len > p->nwrite - p->nread) {
+            len = p->nwrite - p->nread;
         }
 
-        addr[i] = p->data[p->nread++ % PIPESIZE];
+        if(len > n - i) {
+            len = n - i;
+        }
+
+        memmove(addr + i, src, len);
+
+        // wake up the writer only if the pipe was full
+        if(p->nwrite == p->nread + p->size) {
+            wakeup(&p->nwrite);  //DOC: piperead-wakeup
+        }
+
+        p->nread += len;
     }
 
-    wakeup(&p->nwrite);  //DOC: piperead-wakeup
     release(&p->lock);
 
     return i;
 }
+
+// Move up to n bytes from file f into the pipe. Return the number of
+// bytes moved, less than n at the end of f.
+int pipesplicein(struct pipe *p, struct file *f, int n)
+{
+    char *dst;
+    uint len;
+    int i, r;
+
+    acquire(&p->lock);
+
+    r = 0;
+
+    for(i = 0; i < n; i += r){
+        while(p->nwrite == p->nread + p->size || p->wsplice){
+            if(p->readopen == 0){
+                release(&p->lock);
+                return i > 0 ? i : -1;
+            }
+
+            sleep(&p->nwrite, &p->lock);
+        }
+
+        dst = pipeaddr(p, p->nwrite, &len);
+
+        if(len > p->nread + p->size - p->nwrite) {
+            len = p->nread + p->size - p->nwrite;
+        }
+
+        if(len > n - i) {
+            len = n - i;
+        }
+
+        p->wsplice = 1;
+        release(&p->lock);
+
+        r = fileread(f, dst, len);
+
+        acquire(&p->lock);
+        p->wsplice = 0;
+        wakeup(&p->nwrite);
+
+        if(r <= 0) {
+            break;
+        }
+
+        if(p->nwrite == p->nread) {
+            wakeup(&p->nread);
+        }
+
+        p->nwrite += r;
+
+        if(r < len) {
+            i += r;
+            break;
+        }
+    }
+
+    release(&p->lock);
+
+    return (i == 0 && r < 0) ? -1 : i;
+}
+
+// Move up to n bytes from the pipe to file f. Like piperead, wait for
+// data if the pipe is empty, then move what is there.
+int pipespliceout(struct pipe *p, struct file *f, int n)
+{
+    char *src;
+    uint len;
+    int i, r;
+
+    acquire(&p->lock);
+
+    while((p->nread == p->nwrite && p->writeopen) || p->rsplice){
+        if(myproc()->killed){
+            release(&p->lock);
+            return -1;
+        }
+
+        sleep(&p->nread, &p->lock);
+    }
+
+    r = 0;
+
+    for(i = 0; i < n && p->nread != p->nwrite; i += r){
+        src = pipeaddr(p, p->nread, &len);
+
+        if(len > p->nwrite - p->nread) {
+            len = p->nwrite - p->nread;
+        }
+
+        if(len > n - i) {
+            len = n - i;
+        }
+
+        p->rsplice = 1;
+        release(&p->lock);
+
+        r = filewrite(f, src, len);
+
+        acquire(&p->lock);
+        p->rsplice = 0;
+        wakeup(&p->nread);
+
+        if(r <= 0) {
+            break;
+        }
+
+        if(p->nwrite == p->nread + p->size) {
+            wakeup(&p->nwrite);
+        }
+
+        p->nread += r;
+    }
+
+    release(&p->lock);
+
+    return (i == 0 && r < 0) ? -1 : i;
+}
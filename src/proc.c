@@ -24,13 +24,40 @@
 // between two processes, but instead, between the scheduler. Think of scheduler
 // as the idle process.
 //
+// The scheduler does not scan the process table. Each RUNNABLE process is
+// on the run queue of its priority, and runmask has a bit set for each
+// non-empty run queue, so the next process to run is found in O(1). Each
+// SLEEPING process is on a sleep queue hashed by its chan, so wakeup only
+// looks at processes sleeping on chans in the same hash bucket. The procs
+// are allocated from a slab cache and all of them are on ptable.all. All
+// of them are protected by the ptable lock.
+//
+// The priorities form a multi-level feedback queue. A process that uses
+// up its time slice drops to a lower priority, and gets a longer time
+// slice there. A process that wakes up from sleep (I/O-bound) goes up one
+// priority. A process never goes above its base priority (setpriority),
+// and every BOOSTTICKS all the processes are reset to their base priority
+// so that CPU-bound processes are not starved.
+#define TSLICE(prio)    (QUANTUM * ((prio) + 1))
+
+struct pqueue {
+    struct proc *head;
+    struct proc *tail;
+};
+
 struct {
     struct spinlock lock;
-    struct proc proc[NPROC];
+    struct kmem_cache *cache;
+    struct proc *all;   // all processes, through anext/aprev
+    int nproc;
+
+    struct pqueue runq[NPRIO];
+    uint runmask;
+    struct pqueue sleepq[NSLEEPQ];
+    uint boosted;   // ticks of the last priority boost
 } ptable;
 
 static struct proc *initproc;
-struct proc *proc;
 
 int nextpid = 1;
 extern void forkret(void);
@@ -38,41 +65,174 @@ extern void trapret(void);
 
 static void wakeup1(void *chan);
 
+// append p to the tail of queue q
+static void enqueue(struct pqueue *q, struct proc *p)
+{
+    p->next = 0;
+    p->prev = q->tail;
+
+    if(q->tail) {
+        q->tail->next = p;
+    } else {
+        q->head = p;
+    }
+
+    q->tail = p;
+}
+
+// remove p from queue q
+static void dequeue(struct pqueue *q, struct proc *p)
+{
+    if(p->prev) {
+        p->prev->next = p->next;
+    } else {
+        q->head = p->next;
+    }
+
+    if(p->next) {
+        p->next->prev = p->prev;
+    } else {
+        q->tail = p->prev;
+    }
+
+    p->next = p->prev = 0;
+}
+
+static struct pqueue* sleepq(void *chan)
+{
+    // multiplicative hash, chans are often close to each other
+    return &ptable.sleepq[(((uint)chan * 2654435761U) >> 16) & (NSLEEPQ - 1)];
+}
+
+// Make p RUNNABLE and put it on the run queue. The ptable lock must be held.
+static void setrunnable(struct proc *p)
+{
+    p->state = RUNNABLE;
+    enqueue(&ptable.runq[p->prio], p);
+    ptable.runmask |= 1 << p->prio;
+}
+
+// Take the process to run next from the highest priority non-empty run
+// queue, or return 0 if there is none. The ptable lock must be held.
+static struct proc* pickproc(void)
+{
+    struct pqueue *q;
+    struct proc *p;
+    int prio;
+
+    if(ptable.runmask == 0) {
+        return 0;
+    }
+
+    prio = __builtin_ctz(ptable.runmask);
+    q = &ptable.runq[prio];
+    p = q->head;
+    dequeue(q, p);
+
+    if(q->head == 0) {
+        ptable.runmask &= ~(1 << prio);
+    }
+
+    return p;
+}
+
+// Reset all the processes to their base priority. The ptable lock must
+// be held.
+static void boostprio(void)
+{
+    struct proc *p;
+
+    for(p = ptable.all; p; p = p->anext) {
+        if(p->prio == p->bprio) {
+            continue;
+        }
+
+        if(p->state == RUNNABLE) {
+            dequeue(&ptable.runq[p->prio], p);
+
+            if(ptable.runq[p->prio].head == 0) {
+                ptable.runmask &= ~(1 << p->prio);
+            }
+
+            p->prio = p->bprio;
+            setrunnable(p);
+        } else {
+            p->prio = p->bprio;
+        }
+    }
+
+    ptable.boosted = ticks;
+}
+
+// Remove an EMBRYO, failed or reaped process from the process list and
+// free it. The ptable lock must be held.
+static void freeproc(struct proc *p)
+{
+    if(p->aprev) {
+        p->aprev->anext = p->anext;
+    } else {
+        ptable.all = p->anext;
+    }
+
+    if(p->anext) {
+        p->anext->aprev = p->aprev;
+    }
+
+    p->state = UNUSED;
+    ptable.nproc--;
+    kmem_cache_free(ptable.cache, p);
+}
+
 void pinit(void)
 {
     initlock(&ptable.lock, "ptable");
+
+    if((ptable.cache = kmem_cache_create("proc", sizeof(struct proc), 0)) == 0) {
+        panic("pinit");
+    }
 }
 
 //PAGEBREAK: 32
-// Look in the process table for an UNUSED proc.
-// If found, change state to EMBRYO and initialize
-// state required to run in the kernel.
-// Otherwise return 0.
-static struct proc* allocproc(void)
+// Allocate a new proc (at most NPROC of them), add it to the process
+// list in state EMBRYO and initialize state required to run in the
+// kernel. Its first switch runs forkret, which returns to ret (trapret
+// for a user process). Return 0 if there is no memory.
+static struct proc* allocproc(void (*ret)(void))
 {
     struct proc *p;
     char *sp;
 
+    if((p = kmem_cache_alloc(ptable.cache)) == 0) {
+        return 0;
+    }
+
+    memset(p, 0, sizeof(*p));
     acquire(&ptable.lock);
 
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++) {
-        if(p->state == UNUSED) {
-            goto found;
-        }
+    if(ptable.nproc >= NPROC) {
+        release(&ptable.lock);
+        kmem_cache_free(ptable.cache, p);
+        return 0;
+    }
 
+    p->anext = ptable.all;
+
+    if(ptable.all) {
+        ptable.all->aprev = p;
     }
 
-    release(&ptable.lock);
-    return 0;
+    ptable.all = p;
+    ptable.nproc++;
 
-    found:
     p->state = EMBRYO;
     p->pid = nextpid++;
     release(&ptable.lock);
 
     // Allocate kernel stack.
     if((p->kstack = alloc_page ()) == 0){
-        p->state = UNUSED;
+        acquire(&ptable.lock);
+        freeproc(p);
+        release(&ptable.lock);
         return 0;
     }
 
@@ -83,9 +243,9 @@ static struct proc* allocproc(void)
     p->tf = (struct trapframe*)sp;
 
     // Set up new context to start executing at forkret,
-    // which returns to trapret.
+    // which returns to ret.
     sp -= 4;
-    *(uint*)sp = (uint)trapret;
+    *(uint*)sp = (uint)ret;
 
     sp -= 4;
     *(uint*)sp = (uint)p->kstack + KSTACKSIZE;
@@ -105,6 +265,26 @@ static struct proc* allocproc(void)
     return p;
 }
 
+// Create a kernel thread running fn, which must never return. It is a
+// process without user memory that only runs in the kernel.
+struct proc* kthread(char *name, void (*fn)(void))
+{
+    struct proc *p;
+
+    if((p = allocproc(fn)) == 0 || (p->pgdir = kpt_alloc()) == 0) {
+        panic("kthread");
+    }
+
+    safestrcpy(p->name, name, sizeof(p->name));
+    p->prio = p->bprio = 0;
+
+    acquire(&ptable.lock);
+    setrunnable(p);
+    release(&ptable.lock);
+
+    return p;
+}
+
 void error_init ()
 {
     panic ("failed to craft first process\n");
@@ -119,7 +299,7 @@ void userinit(void)
     struct proc *p;
     extern char _binary_initcode_start[], _binary_initcode_size[];
 
-    p = allocproc();
+    p = allocproc(trapret);
     initproc = p;
 
     if((p->pgdir = kpt_alloc()) == NULL) {
@@ -144,31 +324,55 @@ void userinit(void)
 
     safestrcpy(p->name, "initcode", sizeof(p->name));
     p->cwd = namei("/");
+    p->prio = p->bprio = 0;
 
-    p->state = RUNNABLE;
+    acquire(&ptable.lock);
+    setrunnable(p);
+    release(&ptable.lock);
 }
 
-// Grow current process's memory by n bytes.
+// Grow current process's memory by n bytes. The new pages are
+// allocated and zero-filled on the first access (see faultuvm).
 // Return 0 on success, -1 on failure.
 int growproc(int n)
 {
+    struct proc *curproc = myproc();
+    struct seg *sg;
     uint sz;
 
-    sz = proc->sz;
+    sz = curproc->sz;
 
     if(n > 0){
-        if((sz = allocuvm(proc->pgdir, sz, sz + n)) == 0) {
+        if((sz + n < sz) || (sz + n >= UADDR_SZ)) {
             return -1;
         }
 
+        // the pages are allocated at the first touch, but do not promise
+        // more than is free, so that sbrk (and malloc) still fail when
+        // the memory runs out instead of a fault killing the process
+        if(align_up(sz + n, PTE_SZ) - align_up(sz, PTE_SZ) > free_pages() * PTE_SZ) {
+            return -1;
+        }
+
+        sz += n;
+
     } else if(n < 0){
-        if((sz = deallocuvm(proc->pgdir, sz, sz + n)) == 0) {
+        if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0) {
             return -1;
         }
+
+        // cut the segments at the new size, so that memory grown back
+        // later is zero-filled instead of paged in from the executable
+        for(sg = curproc->segs; sg < curproc->segs + curproc->nseg; sg++){
+            if(sg->va + sg->memsz > sz) {
+                sg->memsz = sz > sg->va ? sz - sg->va : 0;
+                sg->filesz = UMIN(sg->filesz, sg->memsz);
+            }
+        }
     }
 
-    proc->sz = sz;
-    switchuvm(proc);
+    curproc->sz = sz;
+    switchuvm(curproc);
 
     return 0;
 }
@@ -178,40 +382,55 @@ int growproc(int n)
 // Caller must set state of returned proc to RUNNABLE.
 int fork(void)
 {
+    struct proc *curproc = myproc();
     int i, pid;
     struct proc *np;
 
     // Allocate process.
-    if((np = allocproc()) == 0) {
+    if((np = allocproc(trapret)) == 0) {
         return -1;
     }
 
     // Copy process state from p.
-    if((np->pgdir = copyuvm(proc->pgdir, proc->sz)) == 0){
+    if((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0){
         free_page(np->kstack);
-        np->kstack = 0;
-        np->state = UNUSED;
+        acquire(&ptable.lock);
+        freeproc(np);
+        release(&ptable.lock);
         return -1;
     }
 
-    np->sz = proc->sz;
-    np->parent = proc;
-    *np->tf = *proc->tf;
+    np->sz = curproc->sz;
+    np->parent = curproc;
+    *np->tf = *curproc->tf;
 
     // Clear r0 so that fork returns 0 in the child.
     np->tf->r0 = 0;
 
     for(i = 0; i < NOFILE; i++) {
-        if(proc->ofile[i]) {
-            np->ofile[i] = filedup(proc->ofile[i]);
+        if(curproc->ofile[i]) {
+            np->ofile[i] = filedup(curproc->ofile[i]);
         }
     }
 
-    np->cwd = idup(proc->cwd);
+    np->cwd = idup(curproc->cwd);
+
+    // the pages not present yet are paged in from the same executable
+    if (curproc->exe) {
+        np->exe = idup(curproc->exe);
+    }
+
+    np->nseg = curproc->nseg;
+    memmove(np->segs, curproc->segs, sizeof(curproc->segs));
 
     pid = np->pid;
-    np->state = RUNNABLE;
-    safestrcpy(np->name, proc->name, sizeof(proc->name));
+    np->prio = curproc->prio;
+    np->bprio = curproc->bprio;
+    safestrcpy(np->name, curproc->name, sizeof(curproc->name));
+
+    acquire(&ptable.lock);
+    setrunnable(np);
+    release(&ptable.lock);
 
     return pid;
 }
@@ -221,32 +440,40 @@ int fork(void)
 // until its parent calls wait() to find out it exited.
 void exit(void)
 {
+    struct proc *curproc = myproc();
     struct proc *p;
     int fd;
 
-    if(proc == initproc) {
+    if(curproc == initproc) {
         panic("init exiting");
     }
 
     // Close all open files.
     for(fd = 0; fd < NOFILE; fd++){
-        if(proc->ofile[fd]){
-            fileclose(proc->ofile[fd]);
-            proc->ofile[fd] = 0;
+        if(curproc->ofile[fd]){
+            fileclose(curproc->ofile[fd]);
+            curproc->ofile[fd] = 0;
         }
     }
 
-    iput(proc->cwd);
-    proc->cwd = 0;
+    iput(curproc->cwd);
+    curproc->cwd = 0;
+
+    if (curproc->exe) {
+        begin_trans();
+        iput(curproc->exe);
+        commit_trans();
+        curproc->exe = 0;
+    }
 
     acquire(&ptable.lock);
 
     // Parent might be sleeping in wait().
-    wakeup1(proc->parent);
+    wakeup1(curproc->parent);
 
     // Pass abandoned children to init.
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-        if(p->parent == proc){
+    for(p = ptable.all; p; p = p->anext){
+        if(p->parent == curproc){
             p->parent = initproc;
 
             if(p->state == ZOMBIE) {
@@ -256,7 +483,7 @@ void exit(void)
     }
 
     // Jump into the scheduler, never to return.
-    proc->state = ZOMBIE;
+    curproc->state = ZOMBIE;
     sched();
 
     panic("zombie exit");
@@ -266,6 +493,7 @@ void exit(void)
 // Return -1 if this process has no children.
 int wait(void)
 {
+    struct proc *curproc = myproc();
     struct proc *p;
     int havekids, pid;
 
@@ -275,8 +503,8 @@ int wait(void)
         // Scan through table looking for zombie children.
         havekids = 0;
 
-        for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-            if(p->parent != proc) {
+        for(p = ptable.all; p; p = p->anext){
+            if(p->parent != curproc) {
                 continue;
             }
 
@@ -286,13 +514,8 @@ int wait(void)
                 // Found one.
                 pid = p->pid;
                 free_page(p->kstack);
-                p->kstack = 0;
                 freevm(p->pgdir);
-                p->state = UNUSED;
-                p->pid = 0;
-                p->parent = 0;
-                p->name[0] = 0;
-                p->killed = 0;
+                freeproc(p);
                 release(&ptable.lock);
 
                 return pid;
@@ -300,13 +523,13 @@ int wait(void)
         }
 
         // No point waiting if we don't have any children.
-        if(!havekids || proc->killed){
+        if(!havekids || curproc->killed){
             release(&ptable.lock);
             return -1;
         }
 
         // Wait for children to exit.  (See wakeup1 call in proc_exit.)
-        sleep(proc, &ptable.lock);  //DOC: wait-sleep
+        sleep(curproc, &ptable.lock);  //DOC: wait-sleep
     }
 }
 
@@ -321,31 +544,35 @@ int wait(void)
 void scheduler(void)
 {
     struct proc *p;
+    uint start;
 
     for(;;){
         // Enable interrupts on this processor.
         sti();
 
-        // Loop over process table looking for process to run.
+        // Take the next process from the run queues.
         acquire(&ptable.lock);
 
-        for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-            if(p->state != RUNNABLE) {
-                continue;
-            }
+        if(ticks - ptable.boosted >= BOOSTTICKS) {
+            boostprio();
+        }
 
+        if((p = pickproc()) != 0){
             // Switch to chosen process.  It is the process's job
             // to release ptable.lock and then reacquire it
             // before jumping back to us.
-            proc = p;
+            mycpu()->proc = p;
             switchuvm(p);
 
             p->state = RUNNING;
+            p->tslice = ticks;
+            start = timer_usec();
 
-            swtch(&cpu->scheduler, proc->context);
+            swtch(&mycpu()->scheduler, myproc()->context);
             // Process is done running for now.
             // It should have changed its p->state before coming back.
-            proc = 0;
+            p->cputime += timer_usec() - start;
+            mycpu()->proc = 0;
         }
 
         release(&ptable.lock);
@@ -364,11 +591,11 @@ void sched(void)
         panic("sched ptable.lock");
     }
 
-    if(cpu->ncli != 1) {
+    if(mycpu()->ncli != 1) {
         panic("sched locks");
     }
 
-    if(proc->state == RUNNING) {
+    if(myproc()->state == RUNNING) {
         panic("sched running");
     }
 
@@ -376,20 +603,98 @@ void sched(void)
         panic("sched interruptible");
     }
 
-    intena = cpu->intena;
-    swtch(&proc->context, cpu->scheduler);
-    cpu->intena = intena;
+    intena = mycpu()->intena;
+    swtch(&myproc()->context, mycpu()->scheduler);
+    mycpu()->intena = intena;
 }
 
 // Give up the CPU for one scheduling round.
 void yield(void)
 {
     acquire(&ptable.lock);  //DOC: yieldlock
-    proc->state = RUNNABLE;
+    setrunnable(myproc());
     sched();
     release(&ptable.lock);
 }
 
+// Called on the way back to user mode. Give up the CPU if the time
+// slice is used up (and drop to a lower priority), or if a process
+// with a higher priority is runnable.
+void preempt(void)
+{
+    struct proc *curproc = myproc();
+
+    // a hint without the lock: most of the time, the slice is not over
+    // and nothing more urgent is runnable, so there is nothing to do
+    if(ticks - curproc->tslice < TSLICE(curproc->prio) &&
+       (ptable.runmask & ((1 << curproc->prio) - 1)) == 0) {
+        return;
+    }
+
+    acquire(&ptable.lock);
+
+    if(curproc->state != RUNNING) {
+        release(&ptable.lock);
+        return;
+    }
+
+    if(ticks - curproc->tslice >= TSLICE(curproc->prio)) {
+        if(curproc->prio < NPRIO - 1) {
+            curproc->prio++;
+        }
+
+    } else if((ptable.runmask & ((1 << curproc->prio) - 1)) == 0) {
+        release(&ptable.lock);
+        return;
+    }
+
+    setrunnable(curproc);
+    sched();
+    release(&ptable.lock);
+}
+
+// Set the base priority of process pid (or the current process if
+// pid is 0). Return the old base priority, or -1 on error.
+int setpriority(int pid, int prio)
+{
+    struct proc *p;
+    int old;
+
+    if(prio < 0 || prio >= NPRIO) {
+        return -1;
+    }
+
+    acquire(&ptable.lock);
+
+    for(p = ptable.all; p; p = p->anext){
+        if(pid ? p->pid != pid : p != myproc()) {
+            continue;
+        }
+
+        old = p->bprio;
+        p->bprio = prio;
+
+        if(p->state == RUNNABLE) {
+            dequeue(&ptable.runq[p->prio], p);
+
+            if(ptable.runq[p->prio].head == 0) {
+                ptable.runmask &= ~(1 << p->prio);
+            }
+
+            p->prio = prio;
+            setrunnable(p);
+        } else {
+            p->prio = prio;
+        }
+
+        release(&ptable.lock);
+        return old;
+    }
+
+    release(&ptable.lock);
+    return -1;
+}
+
 // A fork child's very first scheduling by scheduler()
 // will swtch here.  "Return" to user space.
 void forkret(void)
@@ -404,19 +709,23 @@ void forkret(void)
         // of a regular process (e.g., they call sleep), and thus cannot
         // be run from main().
         first = 0;
+        fsinit(ROOTDEV);
         initlog();
     }
 
-    // Return to "caller", actually trapret (see allocproc).
+    // Return to "caller", actually trapret or a kernel thread's
+    // function (see allocproc).
 }
 
 // Atomically release lock and sleep on chan.
 // Reacquires lock when awakened.
 void sleep(void *chan, struct spinlock *lk)
 {
+    struct proc *curproc = myproc();
+
     //show_callstk("sleep");
 
-    if(proc == 0) {
+    if(curproc == 0) {
         panic("sleep");
     }
 
@@ -434,12 +743,13 @@ void sleep(void *chan, struct spinlock *lk)
     }
 
     // Go to sleep.
-    proc->chan = chan;
-    proc->state = SLEEPING;
+    curproc->chan = chan;
+    curproc->state = SLEEPING;
+    enqueue(sleepq(chan), curproc);
     sched();
 
     // Tidy up.
-    proc->chan = 0;
+    curproc->chan = 0;
 
     // Reacquire original lock.
     if(lk != &ptable.lock){  //DOC: sleeplock2
@@ -452,11 +762,23 @@ void sleep(void *chan, struct spinlock *lk)
 // Wake up all processes sleeping on chan. The ptable lock must be held.
 static void wakeup1(void *chan)
 {
-    struct proc *p;
+    struct pqueue *q;
+    struct proc *p, *next;
+
+    q = sleepq(chan);
+
+    for(p = q->head; p != 0; p = next) {
+        next = p->next;
 
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++) {
-        if(p->state == SLEEPING && p->chan == chan) {
-            p->state = RUNNABLE;
+        if(p->chan == chan) {
+            dequeue(q, p);
+
+            // favor I/O-bound processes
+            if(p->prio > p->bprio) {
+                p->prio--;
+            }
+
+            setrunnable(p);
         }
     }
 }
@@ -477,13 +799,14 @@ int kill(int pid)
 
     acquire(&ptable.lock);
 
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    for(p = ptable.all; p; p = p->anext){
         if(p->pid == pid){
             p->killed = 1;
 
             // Wake process from sleep if necessary.
             if(p->state == SLEEPING) {
-                p->state = RUNNABLE;
+                dequeue(sleepq(p->chan), p);
+                setrunnable(p);
             }
 
             release(&ptable.lock);
@@ -512,18 +835,15 @@ void procdump(void)
     struct proc *p;
     char *state;
 
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-        if(p->state == UNUSED) {
-            continue;
-        }
-
+    for(p = ptable.all; p; p = p->anext){
         if(p->state >= 0 && p->state < NELEM(states) && states[p->state]) {
             state = states[p->state];
         } else {
             state = "???";
         }
 
-        cprintf("%d %s %s\n", p->pid, state, p->name);
+        cprintf("%d %s %s prio %d/%d cpu %d ms faults %d\n", p->pid, state,
+                p->name, p->prio, p->bprio, p->cputime / 1000, p->nfault);
     }
 
     show_callstk("procdump: \n");
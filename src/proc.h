@@ -1,7 +1,7 @@
 #ifndef PROC_INCLUDE_
 #define PROC_INCLUDE_
 
-// Per-CPU state, now we only support one CPU
+// Per-CPU state
 struct cpu {
     uchar           id;             // index into cpus[] below
     struct context*   scheduler;    // swtch() here to enter scheduler
@@ -10,17 +10,29 @@ struct cpu {
     int             ncli;           // Depth of pushcli nesting.
     int             intena;         // Were interrupts enabled before pushcli?
 
-    // Cpu-local storage variables; see below
-    struct cpu*     cpu;
     struct proc*    proc;           // The currently-running process.
 };
 
 extern struct cpu cpus[NCPU];
 extern int ncpu;
 
+// Each CPU keeps the address of its struct cpu in the privileged thread
+// ID register (TPIDRPRW), set up by cpuinit.
+static inline struct cpu* mycpu (void)
+{
+    struct cpu *c;
 
-extern struct cpu* cpu;
-extern struct proc* proc;
+    asm volatile("MRC p15, 0, %[r], c13, c0, 4": [r]"=r" (c)::);
+    return c;
+}
+
+// The process running on this CPU. The kernel is not preemptive (a
+// process only gives up the CPU on the way back to user mode or when
+// it sleeps), so the process cannot move to another CPU in between.
+static inline struct proc* myproc (void)
+{
+    return mycpu()->proc;
+}
 
 //PAGEBREAK: 17
 // Saved registers for kernel context switches. The context switcher
@@ -50,6 +62,15 @@ struct context {
 };
 
 
+// A loadable segment of the program image. Its pages are read from
+// the executable on the first access (see faultuvm in vm.c).
+struct seg {
+    uint    va;             // start virtual address
+    uint    memsz;          // size in memory (including bss)
+    uint    off;            // offset in the executable
+    uint    filesz;         // size in the executable
+};
+
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
@@ -63,9 +84,21 @@ struct proc {
     struct trapframe*   tf;         // Trap frame for current syscall
     struct context* context;        // swtch() here to run process
     void*           chan;           // If non-zero, sleeping on chan
+    struct proc*    next;           // run queue or sleep queue
+    struct proc*    prev;
+    struct proc*    anext;          // list of all processes
+    struct proc*    aprev;
+    int             prio;           // Scheduling priority (0 is the highest)
+    int             bprio;          // Base priority (set by setpriority)
+    uint            cputime;        // CPU time used (in microseconds)
     int             killed;         // If non-zero, have been killed
+    uint            tslice;         // Tick the time slice started at
+    uint            nfault;         // Page faults (page-ins and copies)
     struct file*    ofile[NOFILE];  // Open files
     struct inode*   cwd;            // Current directory
+    struct inode*   exe;            // Executable to page in segs from
+    int             nseg;           // Number of loadable segments
+    struct seg      segs[NSEG];     // Loadable segments of the program
     char            name[16];       // Process name (debugging)
 };
 
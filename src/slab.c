@@ -0,0 +1,244 @@
+// Slab allocator: caches of kernel objects of the same type
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "arm.h"
+
+// Each cache carves objects of one size out of slabs. A slab is a page
+// allocated with kmalloc, its header is at the beginning of the page and
+// the objects follow it. The free objects of a slab are linked through a
+// word after each object, so both allocation and free take O(1), and an
+// object takes one word more than its size instead of the next power of 2.
+//
+// The constructor (if any) is called once for each object, when its slab
+// is created. Objects must be freed in the constructed state (e.g., an
+// embedded lock released), so they need not be constructed again. The
+// link is kept out of the object for this reason.
+//
+// A slab with free objects is on the partial list of its cache, a full
+// slab is on no list. A slab is given back to the buddy allocator once
+// all its objects are free, unless it is the only partial slab (so that
+// alloc/free of a single object do not allocate and free a page).
+
+#define SLAB_ORDER  PTE_SHIFT
+#define SLAB_SZ     (1 << SLAB_ORDER)
+
+struct slab {
+    struct slab         *next;      // partial list of the cache
+    struct slab         *prev;
+    struct kmem_cache   *cache;
+    void                *free;      // free objects
+    uint                inuse;      // allocated objects
+};
+
+struct kmem_cache {
+    struct spinlock     lock;
+    char                *name;
+    uint                size;       // object size, aligned, with the link
+    uint                nobj;       // objects per slab
+    void                (*ctor)(void*);
+    struct slab         *partial;   // slabs with free objects
+    struct kmem_cache   *next;      // all the caches
+
+    // statistics
+    uint                nslab;      // slabs allocated
+    uint                inuse;      // objects allocated
+    uint                allocs;     // calls to kmem_cache_alloc
+    uint                grows;      // allocations that needed a new slab
+};
+
+#define SLAB_HDR    align_up(sizeof(struct slab), sizeof(uint))
+
+// the free list link of obj, in the last word
+#define OBJ_LINK(c, obj)    (*(void**)((char*)(obj) + (c)->size - sizeof(void*)))
+
+static struct {
+    struct spinlock     lock;
+    struct kmem_cache   *caches;
+    struct kmem_cache   cache;      // the cache of the caches
+} slabs;
+
+static void cache_init (struct kmem_cache *c, char *name, uint size,
+                        void (*ctor)(void*))
+{
+    memset(c, 0, sizeof(*c));
+    initlock(&c->lock, name);
+
+    c->name = name;
+    c->size = align_up(size, sizeof(uint)) + sizeof(void*);
+    c->nobj = (SLAB_SZ - SLAB_HDR) / c->size;
+    c->ctor = ctor;
+
+    if (c->nobj == 0) {
+        panic("kmem_cache: object too big");
+    }
+
+    acquire(&slabs.lock);
+    c->next = slabs.caches;
+    slabs.caches = c;
+    release(&slabs.lock);
+}
+
+void slabinit (void)
+{
+    initlock(&slabs.lock, "slabs");
+    cache_init(&slabs.cache, "kmem_cache", sizeof(struct kmem_cache), 0);
+}
+
+// Create a cache of objects of size bytes. ctor (may be 0) is called
+// for each new object.
+struct kmem_cache* kmem_cache_create (char *name, uint size,
+                                      void (*ctor)(void*))
+{
+    struct kmem_cache *c;
+
+    if ((c = kmem_cache_alloc(&slabs.cache)) != NULL) {
+        cache_init(c, name, size, ctor);
+    }
+
+    return c;
+}
+
+// remove slab s from the partial list. Caller holds the cache lock.
+static void slab_unlink (struct kmem_cache *c, struct slab *s)
+{
+    if (s->prev) {
+        s->prev->next = s->next;
+    } else {
+        c->partial = s->next;
+    }
+
+    if (s->next) {
+        s->next->prev = s->prev;
+    }
+
+    s->next = s->prev = NULL;
+}
+
+// add slab s to the head of the partial list. Caller holds the cache lock.
+static void slab_link (struct kmem_cache *c, struct slab *s)
+{
+    s->prev = NULL;
+    s->next = c->partial;
+
+    if (c->partial) {
+        c->partial->prev = s;
+    }
+
+    c->partial = s;
+}
+
+// allocate and construct a new slab, without the cache lock
+static struct slab* slab_grow (struct kmem_cache *c)
+{
+    struct slab *s;
+    char *obj;
+    int i;
+
+    if ((s = kmalloc(SLAB_ORDER)) == NULL) {
+        return NULL;
+    }
+
+    s->next = s->prev = NULL;
+    s->cache = c;
+    s->inuse = 0;
+    s->free = NULL;
+
+    // link the objects in the address order
+    obj = (char*)s + SLAB_HDR + (c->nobj - 1) * c->size;
+
+    for (i = 0; i < c->nobj; i++, obj -= c->size) {
+        if (c->ctor) {
+            c->ctor(obj);
+        }
+
+        OBJ_LINK(c, obj) = s->free;
+        s->free = obj;
+    }
+
+    return s;
+}
+
+// Allocate an object from cache c. Return 0 if out of memory.
+void* kmem_cache_alloc (struct kmem_cache *c)
+{
+    struct slab *s;
+    void *obj;
+
+    acquire(&c->lock);
+    c->allocs++;
+
+    if ((s = c->partial) == NULL) {
+        // do not hold the cache lock in the buddy allocator
+        release(&c->lock);
+
+        if ((s = slab_grow(c)) == NULL) {
+            return NULL;
+        }
+
+        acquire(&c->lock);
+        c->nslab++;
+        c->grows++;
+        slab_link(c, s);
+    }
+
+    obj = s->free;
+    s->free = OBJ_LINK(c, obj);
+    s->inuse++;
+    c->inuse++;
+
+    if (s->free == NULL) {
+        slab_unlink(c, s);
+    }
+
+    release(&c->lock);
+    return obj;
+}
+
+// Free an object allocated from cache c.
+void kmem_cache_free (struct kmem_cache *c, void *obj)
+{
+    struct slab *s;
+
+    s = (struct slab*)align_dn(obj, SLAB_SZ);
+
+    if (s->cache != c) {
+        panic("kmem_cache_free: wrong cache");
+    }
+
+    acquire(&c->lock);
+
+    if (s->free == NULL) {
+        slab_link(c, s);        // it was full
+    }
+
+    OBJ_LINK(c, obj) = s->free;
+    s->free = obj;
+    s->inuse--;
+    c->inuse--;
+
+    if ((s->inuse == 0) && (c->partial != s || s->next != NULL)) {
+        slab_unlink(c, s);
+        c->nslab--;
+        release(&c->lock);
+
+        kfree(s, SLAB_ORDER);
+        return;
+    }
+
+    release(&c->lock);
+}
+
+// Print the statistics of all the caches. No lock, for debugging.
+void slabstat (void)
+{
+    struct kmem_cache *c;
+
+    for (c = slabs.caches; c != NULL; c = c->next) {
+        cprintf("slab %s: size %d, %d objs in %d slabs, allocs %d, grows %d\n",
+                c->name, c->size, c->inuse, c->nslab, c->allocs, c->grows);
+    }
+}
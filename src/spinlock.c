@@ -14,11 +14,31 @@ void initlock(struct spinlock *lk, char *name)
     lk->name = name;
     lk->locked = 0;
     lk->cpu = 0;
+    lk->ncontend = 0;
 }
 
-// For single CPU systems, there is no need for spinlock.
-// Add the support when multi-processor is supported.
+// Atomically store newval into *addr and return the old value.
+// LDREX/STREX are available since ARMv6.
+static inline uint xchg (volatile uint *addr, uint newval)
+{
+    uint old, fail;
+
+    asm volatile("1: LDREX   %[old], [%[a]]\n"
+                 "   STREX   %[f], %[n], [%[a]]\n"
+                 "   CMP     %[f], #0\n"
+                 "   BNE     1b\n"
+                 : [old]"=&r" (old), [f]"=&r" (fail)
+                 : [a]"r" (addr), [n]"r" (newval)
+                 : "cc", "memory");
 
+    return old;
+}
+
+// Data memory barrier. ARMv6 has no DMB instruction, it is a CP15 operation.
+static inline void dmb (void)
+{
+    asm volatile("MCR p15, 0, %[r], c7, c10, 5": :[r]"r" (0):"memory");
+}
 
 // Acquire the lock.
 // Loops (spins) until the lock is acquired.
@@ -26,49 +46,46 @@ void initlock(struct spinlock *lk, char *name)
 // other CPUs to waste time spinning to acquire it.
 void acquire(struct spinlock *lk)
 {
+    int spun;
+
     pushcli();		// disable interrupts to avoid deadlock.
-    lk->locked = 1;	// set the lock status to make the kernel happy
 
-#if 0
     if(holding(lk))
         panic("acquire");
 
-    // The xchg is atomic.
-    // It also serializes, so that reads after acquire are not
-    // reordered before it.
+    spun = 0;
+
     while(xchg(&lk->locked, 1) != 0)
-        ;
+        spun = 1;
+
+    // reads and writes of the critical section must not be
+    // done before the lock is taken
+    dmb();
+
+    // count it under the lock
+    if(spun)
+        lk->ncontend++;
 
     // Record info about lock acquisition for debugging.
-    lk->cpu = cpu;
+    lk->cpu = mycpu();
     getcallerpcs(get_fp(), lk->pcs);
-
-#endif
 }
 
 // Release the lock.
 void release(struct spinlock *lk)
 {
-#if 0
     if(!holding(lk))
         panic("release");
 
     lk->pcs[0] = 0;
     lk->cpu = 0;
 
-    // The xchg serializes, so that reads before release are
-    // not reordered after it.  The 1996 PentiumPro manual (Volume 3,
-    // 7.2) says reads can be carried out speculatively and in
-    // any order, which implies we need to serialize here.
-    // But the 2007 Intel 64 Architecture Memory Ordering White
-    // Paper says that Intel 64 and IA-32 will not move a load
-    // after a store. So lock->locked = 0 would work here.
-    // The xchg being asm volatile ensures gcc emits it after
-    // the above assignments (and after the critical section).
-    xchg(&lk->locked, 0);
-#endif
-
-    lk->locked = 0; // set the lock state to keep the kernel happy
+    // everything done in the critical section must be visible to
+    // other CPUs before the lock is seen free. A plain store clears
+    // the exclusive monitors of the other CPUs.
+    dmb();
+    lk->locked = 0;
+
     popcli();
 }
 
@@ -76,6 +93,5 @@ void release(struct spinlock *lk)
 // Check whether this cpu is holding the lock.
 int holding(struct spinlock *lock)
 {
-    return lock->locked; // && lock->cpu == cpus;
+    return lock->locked && lock->cpu == mycpu();
 }
-
@@ -1,11 +1,12 @@
 // Mutual exclusion lock.
 struct spinlock {
     uint        locked;     // Is the lock held?
+    uint        ncontend;   // times it was found held by acquire
 
     // For debugging:
     char        *name;      // Name of lock.
     struct cpu  *cpu;       // The cpu holding the lock.
-    uint        pcs[10];    // The call stack (an array of program counters)
+    uint        pcs[N_CALLSTK]; // The call stack (an array of program counters)
     // that locked the lock.
 };
 
@@ -11,10 +11,30 @@
 // in r0. Arguments on the stack, from the user call to the C library
 // system call function. The saved user sp points to the first argument.
 
+// Page in the user memory [addr, addr+n) of the current process now.
+// The kernel might access it while holding a spinlock (e.g., pipe) or
+// the inode of the executable, and cannot page it in then.
+static int prefault(uint addr, uint n)
+{
+    uint va;
+
+    for(va = align_dn(addr, PTE_SZ); va < addr+n; va += PTE_SZ) {
+        if(faultuvm(myproc(), va, 0) < 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
 // Fetch the int at addr from the current process.
 int fetchint(uint addr, int *ip)
 {
-    if(addr >= proc->sz || addr+4 > proc->sz) {
+    if(addr >= myproc()->sz || addr+4 > myproc()->sz) {
+        return -1;
+    }
+
+    if(prefault(addr, 4) < 0) {
         return -1;
     }
 
@@ -29,14 +49,18 @@ int fetchstr(uint addr, char **pp)
 {
     char *s, *ep;
 
-    if(addr >= proc->sz) {
+    if(addr >= myproc()->sz) {
         return -1;
     }
 
     *pp = (char*)addr;
-    ep = (char*)proc->sz;
+    ep = (char*)myproc()->sz;
 
     for(s = *pp; s < ep; s++) {
+        if((s == *pp || (uint)s % PTE_SZ == 0) && prefault((uint)s, 1) < 0) {
+            return -1;
+        }
+
         if(*s == 0) {
             return s - *pp;
         }
@@ -54,7 +78,7 @@ int argint(int n, int *ip)
         panic ("too many system call parameters\n");
     }
 
-    *ip = *(&proc->tf->r1 + n);
+    *ip = *(&myproc()->tf->r1 + n);
 
     return 0;
 }
@@ -64,13 +88,18 @@ int argint(int n, int *ip)
 // lies within the process address space.
 int argptr(int n, char **pp, int size)
 {
+    struct proc *curproc = myproc();
     int i;
 
     if(argint(n, &i) < 0) {
         return -1;
     }
 
-    if((uint)i >= proc->sz || (uint)i+size > proc->sz) {
+    if((uint)i >= curproc->sz || (uint)i+size > curproc->sz) {
+        return -1;
+    }
+
+    if(prefault(i, size) < 0) {
         return -1;
     }
 
@@ -114,6 +143,13 @@ extern int sys_unlink(void);
 extern int sys_wait(void);
 extern int sys_write(void);
 extern int sys_uptime(void);
+extern int sys_uptime_us(void);
+extern int sys_setpriority(void);
+extern int sys_sync(void);
+extern int sys_fsync(void);
+extern int sys_fcntl(void);
+extern int sys_splice(void);
+extern int sys_ncommits(void);
 
 static int (*syscalls[])(void) = {
         [SYS_fork]    sys_fork,
@@ -137,14 +173,22 @@ static int (*syscalls[])(void) = {
         [SYS_link]    sys_link,
         [SYS_mkdir]   sys_mkdir,
         [SYS_close]   sys_close,
+        [SYS_uptime_us] sys_uptime_us,
+        [SYS_setpriority] sys_setpriority,
+        [SYS_sync]    sys_sync,
+        [SYS_fsync]   sys_fsync,
+        [SYS_fcntl]   sys_fcntl,
+        [SYS_splice]  sys_splice,
+        [SYS_ncommits] sys_ncommits,
 };
 
 void syscall(void)
 {
+    struct proc *curproc = myproc();
     int num;
     int ret;
 
-    num = proc->tf->r0;
+    num = curproc->tf->r0;
 
     //cprintf ("syscall(%d) from %s(%d)\n", num, proc->name, proc->pid);
 
@@ -155,10 +199,10 @@ void syscall(void)
         // do not set the return value if it is SYS_exec (the user program
         // anyway does not expect us to return anything).
         if (num != SYS_exec) {
-            proc->tf->r0 = ret;
+            curproc->tf->r0 = ret;
         }
     } else {
-        cprintf("%d %s: unknown sys call %d\n", proc->pid, proc->name, num);
-        proc->tf->r0 = -1;
+        cprintf("%d %s: unknown sys call %d\n", curproc->pid, curproc->name, num);
+        curproc->tf->r0 = -1;
     }
 }
@@ -20,3 +20,10 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_uptime_us 22
+#define SYS_setpriority 23
+#define SYS_sync   24
+#define SYS_fsync  25
+#define SYS_fcntl  26
+#define SYS_splice 27
+#define SYS_ncommits 28
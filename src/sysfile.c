@@ -25,7 +25,7 @@ static int argfd(int n, int *pfd, struct file **pf)
         return -1;
     }
 
-    if(fd < 0 || fd >= NOFILE || (f=proc->ofile[fd]) == 0) {
+    if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0) {
         return -1;
     }
 
@@ -47,8 +47,8 @@ static int fdalloc(struct file *f)
     int fd;
 
     for(fd = 0; fd < NOFILE; fd++){
-        if(proc->ofile[fd] == 0){
-            proc->ofile[fd] = f;
+        if(myproc()->ofile[fd] == 0){
+            myproc()->ofile[fd] = f;
             return fd;
         }
     }
@@ -109,7 +109,7 @@ int sys_close(void)
         return -1;
     }
 
-    proc->ofile[fd] = 0;
+    myproc()->ofile[fd] = 0;
     fileclose(f);
 
     return 0;
@@ -127,6 +127,97 @@ int sys_fstat(void)
     return filestat(f, st);
 }
 
+// Commit the changes made so far, and write them to their home
+// locations on disk. The commit alone makes them durable (see log.c),
+// sync also empties the log.
+int sys_sync(void)
+{
+    log_flush();
+    return 0;
+}
+
+// Number of transactions committed to the log so far, to see how many
+// system calls a commit takes on average.
+int sys_ncommits(void)
+{
+    return log_ncommits();
+}
+
+// Control an open file. Only pipes have something to control, their size.
+int sys_fcntl(void)
+{
+    struct file *f;
+    int cmd, arg;
+
+    if(argfd(0, 0, &f) < 0 || argint(1, &cmd) < 0 || argint(2, &arg) < 0) {
+        return -1;
+    }
+
+    if(f->type != FD_PIPE) {
+        return -1;
+    }
+
+    switch(cmd){
+    case F_GETPIPE_SZ:
+        return pipesize(f->pipe);
+
+    case F_SETPIPE_SZ:
+        return piperesize(f->pipe, arg);
+    }
+
+    return -1;
+}
+
+// A regular file never waits for its data, so a splice may reserve the
+// pipe end while it copies (see pipe.c). A device (the console) or
+// another pipe may wait for input forever.
+static int splicable(struct file *f)
+{
+    return f->type == FD_INODE && f->ip->type == T_FILE;
+}
+
+// Move up to n bytes from fdin to fdout without going through user
+// memory. One of them must be a pipe, the other a regular file.
+int sys_splice(void)
+{
+    struct file *in, *out;
+    int n;
+
+    if(argfd(0, 0, &in) < 0 || argfd(1, 0, &out) < 0 || argint(2, &n) < 0) {
+        return -1;
+    }
+
+    if(!in->readable || !out->writable || n < 0) {
+        return -1;
+    }
+
+    if(out->type == FD_PIPE && splicable(in)) {
+        return pipesplicein(out->pipe, in, n);
+    }
+
+    if(in->type == FD_PIPE && splicable(out)) {
+        return pipespliceout(in->pipe, out, n);
+    }
+
+    return -1;
+}
+
+// Make the changes to file fd durable: commit them to the log. A write
+// may return before its commit, if it shares its transaction with system
+// calls still running (see log.c); fsync waits for them and commits. The
+// log is global, so this commits the changes to the other files too.
+int sys_fsync(void)
+{
+    struct file *f;
+
+    if(argfd(0, 0, &f) < 0 || f->type != FD_INODE) {
+        return -1;
+    }
+
+    log_commit();
+    return 0;
+}
+
 // Create the path new as a link to the same inode as old.
 int sys_link(void)
 {
@@ -204,7 +295,6 @@ static int isdirempty(struct inode *dp)
 int sys_unlink(void)
 {
     struct inode *ip, *dp;
-    struct dirent de;
     char name[DIRSIZ], *path;
     uint off;
 
@@ -240,11 +330,7 @@ int sys_unlink(void)
         goto bad;
     }
 
-    memset(&de, 0, sizeof(de));
-
-    if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de)) {
-        panic("unlink: writei");
-    }
+    dirunlink(dp, name, off);
 
     if(ip->type == T_DIR){
         dp->nlink--;
@@ -433,8 +519,8 @@ int sys_chdir(void)
 
     iunlock(ip);
 
-    iput(proc->cwd);
-    proc->cwd = ip;
+    iput(myproc()->cwd);
+    myproc()->cwd = ip;
 
     return 0;
 }
@@ -491,7 +577,7 @@ int sys_pipe(void)
 
     if((fd0 = fdalloc(rf)) < 0 || (fd1 = fdalloc(wf)) < 0){
         if(fd0 >= 0) {
-            proc->ofile[fd0] = 0;
+            myproc()->ofile[fd0] = 0;
         }
 
         fileclose(rf);
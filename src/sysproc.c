@@ -33,9 +33,22 @@ int sys_kill(void)
     return kill(pid);
 }
 
+// set the base scheduling priority of a process (0 is the highest),
+// return the old one.
+int sys_setpriority(void)
+{
+    int pid, prio;
+
+    if(argint(0, &pid) < 0 || argint(1, &prio) < 0) {
+        return -1;
+    }
+
+    return setpriority(pid, prio);
+}
+
 int sys_getpid(void)
 {
-    return proc->pid;
+    return myproc()->pid;
 }
 
 int sys_sbrk(void)
@@ -47,7 +60,7 @@ int sys_sbrk(void)
         return -1;
     }
 
-    addr = proc->sz;
+    addr = myproc()->sz;
 
     if(growproc(n) < 0) {
         return -1;
@@ -70,7 +83,7 @@ int sys_sleep(void)
     ticks0 = ticks;
 
     while(ticks - ticks0 < n){
-        if(proc->killed){
+        if(myproc()->killed){
             release(&tickslock);
             return -1;
         }
@@ -94,3 +107,10 @@ int sys_uptime(void)
 
     return xticks;
 }
+
+// return how many microseconds have passed since start
+// (wraps around in about 71 minutes).
+int sys_uptime_us(void)
+{
+    return timer_usec();
+}
@@ -4,24 +4,53 @@
 #include "param.h"
 #include "arm.h"
 #include "proc.h"
+#include "memlayout.h"
+#include "mmu.h"
 
 // trap routine
 void swi_handler (struct trapframe *r)
 {
-    proc->tf = r;
+    struct proc *curproc = myproc();
+
+    if (curproc->killed) {
+        exit();
+    }
+
+    curproc->tf = r;
     syscall ();
+
+    if (curproc->killed) {
+        exit();
+    }
+
+    preempt();
 }
 
 // trap routine
 void irq_handler (struct trapframe *r)
 {
+    struct proc *curproc = myproc();
+
     // proc points to the current process. If the kernel is
     // running scheduler, proc is NULL.
-    if (proc != NULL) {
-        proc->tf = r;
+    if (curproc != NULL) {
+        curproc->tf = r;
     }
 
     pic_dispatch (r);
+
+    // Only preempt the process when returning to the user mode. The
+    // kernel is not preemptive (it runs with interrupts disabled except
+    // in the scheduler and forkret).
+    if ((curproc == NULL) || ((r->spsr & MODE_MASK) != USR_MODE)) {
+        return;
+    }
+
+    if (curproc->killed) {
+        exit();
+    }
+
+    preempt();
 }
 
 // trap routine
@@ -38,36 +67,79 @@ void und_handler (struct trapframe *r)
     cprintf ("und at: 0x%x \n", r->pc);
 }
 
+// whether the fault status might be resolved by faultuvm: a translation
+// fault (not present) or a permission fault (e.g., copy-on-write)
+static int user_fault (uint fsr)
+{
+    switch (FSR_FS(fsr)) {
+    case FS_TRANS_SEC:
+    case FS_TRANS_PAGE:
+    case FS_PERM_PAGE:
+        return 1;
+    }
+
+    return 0;
+}
+
 // trap routine
 void dabort_handler (struct trapframe *r)
 {
+    struct proc *curproc = myproc();
     uint dfs, fa;
 
-    cli();
-
     // read data fault status register
     asm("MRC p15, 0, %[r], c5, c0, 0": [r]"=r" (dfs)::);
 
     // read the fault address register
     asm("MRC p15, 0, %[r], c6, c0, 0": [r]"=r" (fa)::);
-    
+
+    // a fault on a page of the current process, either from the user
+    // program or from the kernel (e.g., read into a user buffer). It
+    // might be a copy-on-write page, or a page not present yet.
+    if ((curproc != NULL) && user_fault(dfs) &&
+        (faultuvm(curproc, fa, dfs & FSR_WNR) == 0)) {
+        return;
+    }
+
+    cli();
     cprintf ("data abort: instruction 0x%x, fault addr 0x%x, reason 0x%x \n",
              r->pc, fa, dfs);
-    
+
     dump_trapframe (r);
+
+    // kill the offending user process, but a fault in the kernel is fatal
+    if ((curproc != NULL) && ((r->spsr & MODE_MASK) == USR_MODE)) {
+        cprintf ("pid %d %s: killed\n", curproc->pid, curproc->name);
+        exit ();
+    }
+
+    panic ("data abort in kernel");
 }
 
 // trap routine
 void iabort_handler (struct trapframe *r)
 {
+    struct proc *curproc = myproc();
     uint ifs;
-    
-    // read fault status register
-    asm("MRC p15, 0, %[r], c5, c0, 0": [r]"=r" (ifs)::);
+
+    // read instruction fault status register
+    asm("MRC p15, 0, %[r], c5, c0, 1": [r]"=r" (ifs)::);
+
+    // the program text might not be paged in yet
+    if ((curproc != NULL) && user_fault(ifs) && (faultuvm(curproc, r->pc, 0) == 0)) {
+        return;
+    }
 
     cli();
     cprintf ("prefetch abort at: 0x%x (reason: 0x%x)\n", r->pc, ifs);
     dump_trapframe (r);
+
+    if ((curproc != NULL) && ((r->spsr & MODE_MASK) == USR_MODE)) {
+        cprintf ("pid %d %s: killed\n", curproc->pid, curproc->name);
+        exit ();
+    }
+
+    panic ("prefetch abort in kernel");
 }
 
 // trap routine
@@ -89,9 +161,6 @@ void fiq_handler (struct trapframe *r)
 void trap_init ( )
 {
     volatile uint32 *ram_start;
-    char *stk;
-    int i;
-    uint modes[] = {FIQ_MODE, IRQ_MODE, ABT_MODE, UND_MODE};
 
     // the opcode of PC relative load (to PC) instruction LDR pc, [pc,...]
     static uint32 const LDR_PCPC = 0xE59FF000U;
@@ -117,6 +186,17 @@ void trap_init ( )
     ram_start[14] = (uint32)trap_irq;
     ram_start[15] = (uint32)trap_fiq;
 
+    trap_initcpu();
+}
+
+// The banked stack pointers of the exception modes are per CPU. Every
+// CPU needs its own stacks.
+void trap_initcpu (void)
+{
+    char *stk;
+    int i;
+    uint modes[] = {FIQ_MODE, IRQ_MODE, ABT_MODE, UND_MODE};
+
     // initialize the stacks for different mode
     for (i = 0; i < sizeof(modes)/sizeof(uint); i++) {
         stk = alloc_page ();
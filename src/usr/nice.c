@@ -0,0 +1,20 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+// run a command with the given base priority (0 is the highest)
+int
+main(int argc, char **argv)
+{
+    if(argc < 3){
+        printf(2, "usage: nice prio cmd [arg...]\n");
+        exit();
+    }
+    if(setpriority(0, atoi(argv[1])) < 0){
+        printf(2, "nice: bad priority %s\n", argv[1]);
+        exit();
+    }
+    exec(argv[2], argv + 2);
+    printf(2, "nice: exec %s failed\n", argv[2]);
+    exit();
+}
@@ -32,38 +32,22 @@ strlen(char *s)
     return n;
 }
 
-void*
-memset(void *dst, int v, uint n)
+int
+memcmp(const void *v1, const void *v2, uint n)
 {
-	uint8	*p;
-	uint8	c;
-	uint32	val;
-	uint32	*p4;
-
-	p   = dst;
-	c   = v & 0xff;
-	val = (c << 24) | (c << 16) | (c << 8) | c;
-
-	// set bytes before whole uint32
-	for (; (n > 0) && ((uint)p % 4); n--, p++){
-		*p = c;
-	}
-
-	// set memory 4 bytes a time
-	p4 = (uint*)p;
-
-	for (; n >= 4; n -= 4, p4++) {
-		*p4 = val;
-	}
-
-	// set leftover one byte a time
-	p = (uint8*)p4;
-
-	for (; n > 0; n--, p++) {
-		*p = c;
-	}
-
-	return dst;
+    const uchar *s1, *s2;
+    
+    s1 = v1;
+    s2 = v2;
+    if((((uint)s1 | (uint)s2) & 3) == 0)
+        while(n >= 4 && *(uint*)s1 == *(uint*)s2)
+            s1 += 4, s2 += 4, n -= 4;
+    while(n-- > 0){
+        if(*s1 != *s2)
+            return *s1 - *s2;
+        s1++, s2++;
+    }
+    return 0;
 }
 
 char*
@@ -117,15 +101,3 @@ atoi(const char *s)
         n = n*10 + *s++ - '0';
     return n;
 }
-
-void*
-memmove(void *vdst, void *vsrc, int n)
-{
-    char *dst, *src;
-    
-    dst = vdst;
-    src = vsrc;
-    while(n-- > 0)
-        *dst++ = *src++;
-    return vdst;
-}
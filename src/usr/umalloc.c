@@ -43,6 +43,8 @@ free(void *ap)
     freep = p;
 }
 
+// sbrk only reserves the address space, the kernel allocates the
+// pages on the first touch. Asking for 32KB at a time is cheap.
 static Header*
 morecore(uint nu)
 {
@@ -22,6 +22,13 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+int uptime_us(void);
+int setpriority(int, int);
+int sync(void);
+int fsync(int);
+int fcntl(int, int, int);
+int splice(int, int, int);
+int ncommits(void);
 
 // ulib.c
 int stat(char*, struct stat*);
@@ -33,6 +40,7 @@ void printf(int, char*, ...);
 char* gets(char*, int max);
 uint strlen(char*);
 void* memset(void*, int, uint);
+int memcmp(const void*, const void*, uint);
 void* malloc(uint);
 void free(void*);
 int atoi(const char*);
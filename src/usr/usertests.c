@@ -83,10 +83,15 @@ writetest(void)
     printf(stdout, "small file test ok\n");
 }
 
+// bytes in the big file. The direct and indirect blocks cover
+// (NDIRECT + NINDIRECT) blocks, 4MB + 44KB with the 4KB blocks of fs.img
+// (FS_BSIZE in usr/Makefile), so 6MB needs the double indirect block.
+#define BIGSIZE (6*1024*1024)
+
 void
 writetest1(void)
 {
-    int i, fd, n;
+    int i, j, fd, n, t;
     
     printf(stdout, "big files test\n");
     
@@ -96,15 +101,19 @@ writetest1(void)
         exit();
     }
     
-    for(i = 0; i < MAXFILE; i++){
-        ((int*)buf)[0] = i;
-        if(write(fd, buf, 512) != 512){
-            printf(stdout, "error: write big file failed\n", i);
+    t = uptime_us();
+    for(i = 0; i < BIGSIZE / 512; i += sizeof(buf) / 512){
+        for(j = 0; j < sizeof(buf) / 512; j++)
+            ((int*)(buf + j*512))[0] = i + j;
+        if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+            printf(stdout, "error: write big file failed at block %d\n", i);
             exit();
         }
     }
+    t = uptime_us() - t;
     
     close(fd);
+    printf(stdout, "big files: write %d KB/s\n", (BIGSIZE / 1024) * 1000 / (t / 1000 + 1));
     
     fd = open("big", O_RDONLY);
     if(fd < 0){
@@ -113,26 +122,31 @@ writetest1(void)
     }
     
     n = 0;
+    t = uptime_us();
     for(;;){
-        i = read(fd, buf, 512);
+        i = read(fd, buf, sizeof(buf));
         if(i == 0){
-            if(n == MAXFILE - 1){
+            if(n != BIGSIZE / 512){
                 printf(stdout, "read only %d blocks from big", n);
                 exit();
             }
             break;
-        } else if(i != 512){
+        } else if(i != sizeof(buf)){
             printf(stdout, "read failed %d\n", i);
             exit();
         }
-        if(((int*)buf)[0] != n){
-            printf(stdout, "read content of block %d is %d\n",
-                   n, ((int*)buf)[0]);
-            exit();
+        for(j = 0; j < sizeof(buf) / 512; j++, n++){
+            if(((int*)(buf + j*512))[0] != n){
+                printf(stdout, "read content of block %d is %d\n",
+                       n, ((int*)(buf + j*512))[0]);
+                exit();
+            }
         }
-        n++;
     }
+    t = uptime_us() - t;
     close(fd);
+    printf(stdout, "big files: read %d KB/s\n", (BIGSIZE / 1024) * 1000 / (t / 1000 + 1));
+    
     if(unlink("big") < 0){
         printf(stdout, "unlink big failed\n");
         exit();
@@ -253,6 +267,345 @@ pipe1(void)
     printf(1, "pipe1 ok\n");
 }
 
+// pipe bandwidth with the default and the largest pipe size, and the
+// size of a pipe changed with data in it
+#define NPIPEBYTES (4 * 1024 * 1024)
+void
+pipebench(void)
+{
+    int fds[2], pid, sz, n, total, t;
+
+    printf(1, "pipe benchmark\n");
+
+    for(sz = 0; sz <= 65536; sz += 65536){
+        if(pipe(fds) != 0){
+            printf(1, "pipe() failed\n");
+            exit();
+        }
+        if(sz != 0 && fcntl(fds[1], F_SETPIPE_SZ, sz) != sz){
+            printf(1, "pipe resize failed\n");
+            exit();
+        }
+        t = uptime_us();
+        pid = fork();
+        if(pid < 0){
+            printf(1, "fork() failed\n");
+            exit();
+        }
+        if(pid == 0){
+            close(fds[0]);
+            for(total = 0; total < NPIPEBYTES; total += sizeof(buf)){
+                if(write(fds[1], buf, sizeof(buf)) != sizeof(buf)){
+                    printf(1, "pipebench write failed\n");
+                    exit();
+                }
+            }
+            exit();
+        }
+        close(fds[1]);
+        total = 0;
+        while((n = read(fds[0], buf, sizeof(buf))) > 0)
+            total += n;
+        close(fds[0]);
+        wait();
+        t = uptime_us() - t;
+        if(total != NPIPEBYTES){
+            printf(1, "pipebench total %d\n", total);
+            exit();
+        }
+        printf(1, "pipe: %d byte pipe %d KB/s\n", sz ? sz : 4096,
+               (NPIPEBYTES / 1024) * 1000 / (t / 1000 + 1));
+    }
+
+    if(pipe(fds) != 0){
+        printf(1, "pipe() failed\n");
+        exit();
+    }
+    memset(buf, 'p', 6000);
+    if(fcntl(fds[0], F_SETPIPE_SZ, 8192) != 8192 ||
+       write(fds[1], buf, 6000) != 6000 ||
+       fcntl(fds[0], F_SETPIPE_SZ, 4096) != -1 ||
+       fcntl(fds[0], F_SETPIPE_SZ, 20000) != 32768 ||
+       fcntl(fds[0], F_GETPIPE_SZ, 0) != 32768){
+        printf(1, "pipe resize wrong\n");
+        exit();
+    }
+    memset(buf, 0, 6000);
+    if(read(fds[0], buf, sizeof(buf)) != 6000 || buf[0] != 'p' || buf[5999] != 'p'){
+        printf(1, "pipe resize lost data\n");
+        exit();
+    }
+    close(fds[0]);
+    close(fds[1]);
+
+    printf(1, "pipe benchmark ok\n");
+}
+
+// copy a file into a pipe with read/write and with splice, then splice
+// the pipe into a file and check what arrived
+#define NSPLICE (256 * 1024)
+void
+splicetest(void)
+{
+    int fds[2], fd, pid, use, n, i, total, t;
+
+    printf(1, "splice test\n");
+
+    unlink("splicefile");
+    fd = open("splicefile", O_CREATE | O_RDWR);
+    if(fd < 0){
+        printf(1, "cannot create splicefile\n");
+        exit();
+    }
+    for(i = 0; i < NSPLICE; i += sizeof(buf)){
+        memset(buf, i / sizeof(buf), sizeof(buf));
+        if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+            printf(1, "write splicefile failed\n");
+            exit();
+        }
+    }
+    close(fd);
+
+    for(use = 0; use < 2; use++){
+        if(pipe(fds) != 0){
+            printf(1, "pipe() failed\n");
+            exit();
+        }
+        t = uptime_us();
+        pid = fork();
+        if(pid < 0){
+            printf(1, "fork() failed\n");
+            exit();
+        }
+        if(pid == 0){
+            close(fds[0]);
+            fd = open("splicefile", 0);
+            if(use)
+                while(splice(fd, fds[1], 4096) > 0)
+                    ;
+            else
+                while((n = read(fd, buf, 4096)) > 0)
+                    write(fds[1], buf, n);
+            exit();
+        }
+        close(fds[1]);
+        total = 0;
+        while((n = read(fds[0], buf, sizeof(buf))) > 0)
+            total += n;
+        close(fds[0]);
+        wait();
+        t = uptime_us() - t;
+        if(total != NSPLICE){
+            printf(1, "splice total %d\n", total);
+            exit();
+        }
+        printf(1, "splice: file to pipe with %s %d KB/s\n", use ? "splice" : "read/write",
+               (NSPLICE / 1024) * 1000 / (t / 1000 + 1));
+    }
+
+    // another writer of the pipe gets in while a splice fills it
+    if(pipe(fds) != 0){
+        printf(1, "pipe() failed\n");
+        exit();
+    }
+    for(i = 0; i < 2; i++){
+        pid = fork();
+        if(pid < 0){
+            printf(1, "fork() failed\n");
+            exit();
+        }
+        if(pid == 0){
+            close(fds[0]);
+            if(i == 0){
+                fd = open("splicefile", 0);
+                while(splice(fd, fds[1], 4096) > 0)
+                    ;
+            } else {
+                memset(buf, 0, 4096);
+                if(write(fds[1], buf, 4096) != 4096)
+                    printf(1, "write into a spliced pipe failed\n");
+            }
+            exit();
+        }
+    }
+    close(fds[1]);
+    total = 0;
+    while((n = read(fds[0], buf, sizeof(buf))) > 0)
+        total += n;
+    close(fds[0]);
+    wait();
+    wait();
+    if(total != NSPLICE + 4096){
+        printf(1, "splice and write total %d\n", total);
+        exit();
+    }
+
+    // pipe to file
+    if(pipe(fds) != 0){
+        printf(1, "pipe() failed\n");
+        exit();
+    }
+    pid = fork();
+    if(pid == 0){
+        close(fds[0]);
+        fd = open("splicefile", 0);
+        while(splice(fd, fds[1], 4096) > 0)
+            ;
+        exit();
+    }
+    close(fds[1]);
+    unlink("splicefile2");
+    fd = open("splicefile2", O_CREATE | O_RDWR);
+    while(splice(fds[0], fd, 8192) > 0)
+        ;
+    close(fds[0]);
+    close(fd);
+    wait();
+
+    fd = open("splicefile2", 0);
+    for(i = 0; i < NSPLICE; i += sizeof(buf)){
+        if(read(fd, buf, sizeof(buf)) != sizeof(buf) ||
+           buf[0] != (char)(i / sizeof(buf)) || buf[sizeof(buf) - 1] != (char)(i / sizeof(buf))){
+            printf(1, "splice wrong data\n");
+            exit();
+        }
+    }
+    if(read(fd, buf, 1) != 0){
+        printf(1, "splice too much data\n");
+        exit();
+    }
+    close(fd);
+    unlink("splicefile");
+    unlink("splicefile2");
+
+    // a pipe or a device may wait for input, splice refuses them
+    if(pipe(fds) != 0){
+        printf(1, "pipe() failed\n");
+        exit();
+    }
+    if(splice(fds[0], fds[1], 1) >= 0 || splice(0, fds[1], 1) >= 0 ||
+       splice(fds[0], 1, 1) >= 0){
+        printf(1, "splice accepted a pipe or a device\n");
+        exit();
+    }
+    close(fds[0]);
+    close(fds[1]);
+
+    printf(1, "splice test ok\n");
+}
+
+// bandwidth of memmove, memset and memcmp on 16KB blocks, aligned and
+// not, against a byte loop. Reported in bytes/us (MB/s).
+#define NMEMBLK 16384
+#define NMEMBYTES (16 * 1024 * 1024)
+char membuf1[NMEMBLK + 8], membuf2[NMEMBLK + 8];
+
+void
+memreport(char *what, int t)
+{
+    t = t ? t : 1;
+    printf(1, "mem: %s %d.%d bytes/us\n", what, NMEMBYTES / t, NMEMBYTES * 10 / t % 10);
+}
+
+void
+membench(void)
+{
+    int i, j, t;
+    char *d, *s;
+
+    printf(1, "mem benchmark\n");
+
+    t = uptime_us();
+    for(i = 0; i < NMEMBYTES; i += NMEMBLK){
+        d = membuf1;
+        s = membuf2;
+        for(j = 0; j < NMEMBLK; j++)
+            *d++ = *s++;
+    }
+    memreport("byte loop", uptime_us() - t);
+
+    t = uptime_us();
+    for(i = 0; i < NMEMBYTES; i += NMEMBLK)
+        memmove(membuf1, membuf2, NMEMBLK);
+    memreport("memmove aligned", uptime_us() - t);
+
+    t = uptime_us();
+    for(i = 0; i < NMEMBYTES; i += NMEMBLK)
+        memmove(membuf1 + 1, membuf2 + 2, NMEMBLK);
+    memreport("memmove unaligned", uptime_us() - t);
+
+    t = uptime_us();
+    for(i = 0; i < NMEMBYTES; i += NMEMBLK)
+        memmove(membuf1 + 4, membuf1, NMEMBLK);
+    memreport("memmove overlapping", uptime_us() - t);
+
+    // same alignment, so the backward move goes by LDMDB/STMDB
+    for(t = 0; t < NMEMBLK; t++)
+        membuf1[t] = t * 7;
+    memmove(membuf1 + 4, membuf1, NMEMBLK);
+    for(t = 0; t < NMEMBLK; t++)
+        if(membuf1[4 + t] != (char)(t * 7)){
+            printf(1, "memmove overlapping wrong at %d\n", t);
+            exit();
+        }
+
+    t = uptime_us();
+    for(i = 0; i < NMEMBYTES; i += NMEMBLK)
+        memset(membuf1 + 1, i, NMEMBLK);
+    memreport("memset", uptime_us() - t);
+
+    memset(membuf2, 'm', NMEMBLK);
+    memmove(membuf1, membuf2, NMEMBLK);
+    t = uptime_us();
+    for(i = 0; i < NMEMBYTES; i += NMEMBLK)
+        if(memcmp(membuf1, membuf2, NMEMBLK) != 0){
+            printf(1, "memcmp wrong\n");
+            exit();
+        }
+    memreport("memcmp", uptime_us() - t);
+
+    // check the copies at every alignment and length near the edges,
+    // and the overlapping moves both ways by 4 - i bytes: with i == 0
+    // src and dst are aligned alike and long moves go by words, else
+    // by bytes
+    for(i = 0; i < 4; i++){
+        for(j = 0; j < 100; j++){
+            for(t = 0; t < 128; t++)
+                membuf2[t] = t * 7;
+            memset(membuf1, 0, 128);
+            memmove(membuf1 + i, membuf2 + 3, j);
+            if(memcmp(membuf1 + i, membuf2 + 3, j) != 0 ||
+               membuf1[i + j] != 0 || (i > 0 && membuf1[i - 1] != 0)){
+                printf(1, "memmove wrong, offset %d length %d\n", i, j);
+                exit();
+            }
+            memmove(membuf2 + 5 - i, membuf2 + 1, j);
+            for(t = 0; t < j; t++)
+                if(membuf2[5 - i + t] != (char)((1 + t) * 7)){
+                    printf(1, "memmove up wrong, offset %d length %d\n", i, j);
+                    exit();
+                }
+            for(t = 0; t < 128; t++)
+                membuf2[t] = t * 7;
+            memmove(membuf2 + 1, membuf2 + 5 - i, j);
+            for(t = 0; t < j; t++)
+                if(membuf2[1 + t] != (char)((5 - i + t) * 7)){
+                    printf(1, "memmove down wrong, offset %d length %d\n", i, j);
+                    exit();
+                }
+            memset(membuf1, 0, 128);
+            memset(membuf1 + i, 0x100 + j, j);
+            for(t = 0; t < 128; t++)
+                if(membuf1[t] != (t >= i && t < i + j ? (char)j : 0)){
+                    printf(1, "memset wrong, offset %d length %d\n", i, j);
+                    exit();
+                }
+        }
+    }
+
+    printf(1, "mem benchmark ok\n");
+}
+
 // meant to be run w/ at most two CPUs
 void
 preempt(void)
@@ -299,6 +652,190 @@ preempt(void)
     printf(1, "preempt ok\n");
 }
 
+// wakeup-to-run delay of a process sleeping for one tick while a
+// CPU-bound process is running. It is bounded by the time slice.
+void
+schedlatency(void)
+{
+    int i, pid, t0, t1, tick, lat, total, max;
+    
+#define NSCHEDLAT 20
+    printf(1, "sched latency test\n");
+    
+    pid = fork();
+    if(pid < 0){
+        printf(1, "fork failed\n");
+        exit();
+    }
+    if(pid == 0)
+        for(;;)
+            ;
+    
+    total = max = 0;
+    for(i = 0; i < NSCHEDLAT; i++){
+        t0 = uptime_us();
+        sleep(1);
+        t1 = uptime_us();
+        
+        // we are woken up by the first tick after t0
+        tick = (t0 / (1000000 / HZ) + 1) * (1000000 / HZ);
+        lat = t1 - tick;
+        total += lat;
+        if(lat > max)
+            max = lat;
+    }
+    
+    kill(pid);
+    wait();
+    
+    printf(1, "sched latency: avg %d us, max %d us (quantum %d us)\n",
+           total / NSCHEDLAT, max, QUANTUM * (1000000 / HZ));
+    printf(1, "sched latency ok\n");
+}
+
+// a CPU-bound process at the highest priority must get most of the
+// CPU time while a CPU-bound process at the lowest priority is runnable.
+void
+prioritytest(void)
+{
+    int pid, t0, last, now, stolen;
+
+    printf(1, "priority test\n");
+
+    if(setpriority(0, NPRIO) != -1 || setpriority(0, -1) != -1){
+        printf(1, "setpriority accepted a bad priority\n");
+        exit();
+    }
+
+    pid = fork();
+    if(pid < 0){
+        printf(1, "fork failed\n");
+        exit();
+    }
+    if(pid == 0){
+        setpriority(0, NPRIO - 1);
+        for(;;)
+            ;
+    }
+
+    if(setpriority(0, 0) < 0){
+        printf(1, "setpriority failed\n");
+        exit();
+    }
+
+    // spin for a second, the gaps in the clock are the time the
+    // low priority process has run
+    stolen = 0;
+    t0 = last = uptime_us();
+    while((now = uptime_us()) - t0 < 1000000){
+        if(now - last > 1000000 / HZ)
+            stolen += now - last;
+        last = now;
+    }
+
+    kill(pid);
+    wait();
+
+    printf(1, "priority: low priority process ran %d ms of 1000 ms\n",
+           stolen / 1000);
+    if(stolen > 500000){
+        printf(1, "priority failed\n");
+        exit();
+    }
+    printf(1, "priority ok\n");
+}
+
+// sync and fsync
+void
+synctest(void)
+{
+    int fd;
+
+    printf(1, "sync test\n");
+
+    fd = open("syncf", O_CREATE|O_RDWR);
+    if(fd < 0){
+        printf(1, "create syncf failed\n");
+        exit();
+    }
+    if(write(fd, "aaaaaaaaaa", 10) != 10){
+        printf(1, "write syncf failed\n");
+        exit();
+    }
+    if(fsync(fd) != 0){
+        printf(1, "fsync failed\n");
+        exit();
+    }
+    close(fd);
+
+    if(fsync(fd) != -1){
+        printf(1, "fsync of a closed fd succeeded\n");
+        exit();
+    }
+    if(unlink("syncf") != 0 || sync() != 0){
+        printf(1, "sync failed\n");
+        exit();
+    }
+
+    printf(1, "sync ok\n");
+}
+
+// file creation throughput of 1, 2, 4 and 8 parallel creators. With
+// group commit, concurrent creates share commits.
+#define NCREATE 40
+void
+createbench(void)
+{
+    int n, i, j, pid, fd, t, c;
+    char name[4];
+
+    printf(1, "create benchmark\n");
+
+    for(n = 1; n <= 8; n *= 2){
+        t = uptime_us();
+        c = ncommits();
+        for(i = 0; i < n; i++){
+            pid = fork();
+            if(pid < 0){
+                printf(1, "fork failed\n");
+                exit();
+            }
+            if(pid == 0){
+                name[0] = 'c';
+                name[1] = '0' + i;
+                name[3] = '\0';
+                for(j = 0; j < NCREATE / n; j++){
+                    name[2] = '0' + j % 10;
+                    fd = open(name, O_CREATE | O_RDWR);
+                    if(fd < 0){
+                        printf(1, "create %s failed\n", name);
+                        exit();
+                    }
+                    close(fd);
+                    unlink(name);
+                }
+                exit();
+            }
+        }
+        for(i = 0; i < n; i++)
+            wait();
+        t = uptime_us() - t;
+        c = ncommits() - c;
+
+        printf(1, "create: %d creators, %d creates/sec, %d commits\n", n,
+               (NCREATE / n) * n * 1000 / (t / 1000 + 1), c);
+
+        // a create alone takes a commit for the open and one for the
+        // unlink; the creators that wait for a commit share the next one
+        if(n == 8 && c >= (NCREATE / n) * n){
+            printf(1, "create: no group commit\n");
+            exit();
+        }
+    }
+
+    printf(1, "create benchmark ok\n");
+}
+
 // try to find any races between exit and wait
 void
 exitwait(void)
@@ -793,7 +1330,7 @@ linkunlink()
 void
 bigdir(void)
 {
-    int i, fd;
+    int i, fd, t;
     char name[10];
     
     printf(1, "bigdir test\n");
@@ -806,6 +1343,7 @@ bigdir(void)
     }
     close(fd);
     
+    t = uptime_us();
     for(i = 0; i < 500; i++){
         name[0] = 'x';
         name[1] = '0' + (i / 64);
@@ -816,6 +1354,8 @@ bigdir(void)
             exit();
         }
     }
+    t = uptime_us() - t;
+    printf(1, "bigdir: %d links/sec\n", 500 * 1000 / (t / 1000 + 1));
     
     unlink("bd");
     for(i = 0; i < 500; i++){
@@ -1045,10 +1585,12 @@ bigwrite(void)
     printf(1, "bigwrite ok\n");
 }
 
+#define NBIGWRITE 4000  // 600-byte writes, 2.3MB
+
 void
 bigfile(void)
 {
-    int fd, i, total, cc;
+    int fd, i, total, cc, t;
     
     printf(1, "bigfile test\n");
     
@@ -1058,7 +1600,8 @@ bigfile(void)
         printf(1, "cannot create bigfile");
         exit();
     }
-    for(i = 0; i < 20; i++){
+    t = uptime_us();
+    for(i = 0; i < NBIGWRITE; i++){
         memset(buf, i, 600);
         if(write(fd, buf, 600) != 600){
             printf(1, "write bigfile failed\n");
@@ -1066,6 +1609,8 @@ bigfile(void)
         }
     }
     close(fd);
+    t = uptime_us() - t;
+    printf(1, "bigfile: write %d KB/s\n", (NBIGWRITE * 600 / 1024) * 1000 / (t / 1000 + 1));
     
     fd = open("bigfile", 0);
     if(fd < 0){
@@ -1073,6 +1618,7 @@ bigfile(void)
         exit();
     }
     total = 0;
+    t = uptime_us();
     for(i = 0; ; i++){
         cc = read(fd, buf, 300);
         if(cc < 0){
@@ -1085,14 +1631,16 @@ bigfile(void)
             printf(1, "short read bigfile\n");
             exit();
         }
-        if(buf[0] != i/2 || buf[299] != i/2){
+        if(buf[0] != (char)(i/2) || buf[299] != (char)(i/2)){
             printf(1, "read bigfile wrong data\n");
             exit();
         }
         total += cc;
     }
     close(fd);
-    if(total != 20*600){
+    t = uptime_us() - t;
+    printf(1, "bigfile: read %d KB/s\n", (total / 1024) * 1000 / (t / 1000 + 1));
+    if(total != NBIGWRITE*600){
         printf(1, "read bigfile wrong total\n");
         exit();
     }
@@ -1248,7 +1796,7 @@ iref(void)
     
     printf(1, "empty file name\n");
     
-    // the 50 is NINODE
+    // more than the 50 inodes the cache used to be limited to
     for(i = 0; i < 50 + 1; i++){
         if(mkdir("irefd") != 0){
             printf(1, "mkdir irefd failed\n");
@@ -1312,6 +1860,55 @@ forktest(void)
     printf(1, "fork test OK\n");
 }
 
+// fork latency of a big process. With copy-on-write fork, the cost is
+// proportional to the size of the page table, not the process memory.
+void
+forkbench(void)
+{
+    int i, pid, t0, t1;
+    char *a, *p;
+    
+#define FORKBENCH_SZ (4*1024*1024)
+#define NFORKBENCH 50
+    printf(1, "fork benchmark\n");
+    
+    a = sbrk(FORKBENCH_SZ);
+    if(a == (char*)-1){
+        printf(1, "fork benchmark sbrk failed\n");
+        exit();
+    }
+    for(p = a; p < a + FORKBENCH_SZ; p += 4096)
+        *p = 1;
+    
+    t0 = uptime();
+    for(i = 0; i < NFORKBENCH; i++){
+        pid = fork();
+        if(pid < 0){
+            printf(1, "fork benchmark fork failed\n");
+            exit();
+        }
+        if(pid == 0){
+            // must not be seen by the parent
+            a[i * 4096] = 2;
+            exit();
+        }
+        wait();
+    }
+    t1 = uptime();
+    
+    for(i = 0; i < NFORKBENCH; i++){
+        if(a[i * 4096] != 1){
+            printf(1, "fork benchmark: child write visible in parent\n");
+            exit();
+        }
+    }
+    
+    printf(1, "fork benchmark: %d forks of a %d KB process in %d ticks\n",
+           NFORKBENCH, (uint)sbrk(0)/1024, t1 - t0);
+    sbrk(-FORKBENCH_SZ);
+    printf(1, "fork benchmark ok\n");
+}
+
 void
 sbrktest(void)
 {
@@ -1620,8 +2217,15 @@ main(int argc, char *argv[])
     createtest();
     
     mem();
+    membench();
     pipe1();
-    //preempt();
+    pipebench();
+    splicetest();
+    preempt();
+    schedlatency();
+    prioritytest();
+    synctest();
+    createbench();
     exitwait();
     
     rmdot();
@@ -1638,6 +2242,7 @@ main(int argc, char *argv[])
     dirfile();
     iref();
     forktest();
+    forkbench();
     bigdir(); // slow
     
     exectest();
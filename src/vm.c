@@ -147,6 +147,17 @@ static int mappages (pde_t *pgdir, void *va, uint size, uint pa, int ap)
     return 0;
 }
 
+// make the instructions written through the kernel map visible: clean
+// the data cache, then invalidate the instruction cache
+static void sync_icache (void)
+{
+    uint val = 0;
+
+    asm ("MCR p15,0,%[r],c7,c10,0": :[r]"r" (val):);
+    asm ("MCR p15,0,%[r],c7,c10,4": :[r]"r" (val):);
+    asm ("MCR p15,0,%[r],c7,c5,0": :[r]"r" (val):);
+}
+
 // flush all TLB
 static void flush_tlb (void)
 {
@@ -187,7 +198,7 @@ void inituvm (pde_t *pgdir, char *init, uint sz)
     }
 
     mem = alloc_page();
-    memset(mem, 0, PTE_SZ);
+    zero_page(mem);
     mappages(pgdir, 0, PTE_SZ, v2p(mem), AP_KU);
     memmove(mem, init, sz);
 }
@@ -250,7 +261,7 @@ int allocuvm (pde_t *pgdir, uint oldsz, uint newsz)
             return 0;
         }
 
-        memset(mem, 0, PTE_SZ);
+        zero_page(mem);
         mappages(pgdir, (char*) a, PTE_SZ, v2p(mem), AP_KU);
     }
 
@@ -276,8 +287,8 @@ int deallocuvm (pde_t *pgdir, uint oldsz, uint newsz)
 
         if (!pte) {
             // pte == 0 --> no page table for this entry
-            // round it up to the next page directory
-            a = align_up (a, PDE_SZ);
+            // skip to the next page directory
+            a = align_up (a + 1, PDE_SZ) - PTE_SZ;
 
         } else if ((*pte & PE_TYPES) != 0) {
             pa = PTE_ADDR(*pte);
@@ -286,7 +297,7 @@ int deallocuvm (pde_t *pgdir, uint oldsz, uint newsz)
                 panic("deallocuvm");
             }
 
-            free_page(p2v(pa));
+            put_page(p2v(pa));
             *pte = 0;
         }
     }
@@ -334,14 +345,15 @@ void clearpteu (pde_t *pgdir, char *uva)
     *pte = (*pte & ~(0x03 << 4)) | AP_KO << 4;
 }
 
-// Given a parent process's page table, create a copy
-// of it for a child.
+// Given a parent process's page table, create a copy of it for a child.
+// The pages are not copied, both parent and child map them read-only
+// (copy-on-write). The first write to a page faults, and cowuvm gives
+// the writer its own copy.
 pde_t* copyuvm (pde_t *pgdir, uint sz)
 {
     pde_t *d;
-    pte_t *pte;
-    uint pa, i, ap;
-    char *mem;
+    pte_t *pte, *npte;
+    uint pa, i;
 
     // allocate a new first level page directory
     d = kpt_alloc();
@@ -349,32 +361,158 @@ pde_t* copyuvm (pde_t *pgdir, uint sz)
         return NULL ;
     }
 
-    // copy the whole address space over (no COW)
     for (i = 0; i < sz; i += PTE_SZ) {
+        // pages not present yet are paged in on demand by the child too
         if ((pte = walkpgdir(pgdir, (void *) i, 0)) == 0) {
-            panic("copyuvm: pte should exist");
+            i = align_up (i + 1, PDE_SZ) - PTE_SZ;
+            continue;
         }
 
         if (!(*pte & PE_TYPES)) {
-            panic("copyuvm: page not present");
+            continue;
+        }
+
+        // write-protect writable pages in the parent
+        if (PTE_AP(*pte) == AP_KU) {
+            *pte = (*pte & ~(0x03 << 4)) | (AP_KUR << 4) | PTE_APX;
+        }
+
+        if ((npte = walkpgdir(d, (void *) i, 1)) == 0) {
+            goto bad;
         }
 
         pa = PTE_ADDR (*pte);
-        ap = PTE_AP (*pte);
+        get_page(p2v(pa));
+        *npte = *pte;
+    }
+
+    flush_tlb();
+    return d;
 
+bad: freevm(d);
+    flush_tlb();
+    return 0;
+}
+
+// Resolve a write to the copy-on-write page at user address va: copy
+// the page if it is still shared, otherwise just make it writable again.
+// Return 0 on success, -1 if va is not a copy-on-write page.
+int cowuvm (pde_t *pgdir, uint va)
+{
+    pte_t *pte;
+    uint pa;
+    char *mem;
+
+    if (((pte = walkpgdir(pgdir, (void*) va, 0)) == 0) || !PTE_COW(*pte)) {
+        return -1;
+    }
+
+    pa = PTE_ADDR(*pte);
+
+    if (page_refcnt(p2v(pa)) > 1) {
         if ((mem = alloc_page()) == 0) {
-            goto bad;
+            return -1;
         }
 
-        memmove(mem, (char*) p2v(pa), PTE_SZ);
+        copy_page(mem, p2v(pa));
+        put_page(p2v(pa));
+        pa = v2p(mem);
+    }
 
-        if (mappages(d, (void*) i, PTE_SZ, v2p(mem), ap) < 0) {
-            goto bad;
+    *pte = pa | (*pte & (PTE_SZ - 1) & ~(PTE_APX | (0x03 << 4))) | (AP_KU << 4);
+    flush_tlb();
+
+    return 0;
+}
+
+// Read the parts of the program segments of p that cover the page
+// at user address a into mem. Return 0 on success, -1 on error.
+static int loadseg (struct proc *p, char *mem, uint a)
+{
+    struct seg *sg;
+    uint start, end;
+
+    for (sg = p->segs; sg < p->segs + p->nseg; sg++) {
+        start = UMAX(a, sg->va);
+        end = UMIN(a + PTE_SZ, sg->va + sg->filesz);
+
+        if (start >= end) {
+            continue;
+        }
+
+        // reading the inode might sleep, which is not allowed if
+        // the kernel faults while holding a spinlock, and ilock would
+        // never return if the fault is in a readi of the executable
+        // itself. The system calls page in their user memory first
+        // (argptr, fetchstr), so that neither happens.
+        if ((p->exe == 0) || (mycpu()->ncli > 0) || iholding(p->exe)) {
+            return -1;
+        }
+
+        ilock(p->exe);
+
+        if (readi(p->exe, mem + (start - a), sg->off + (start - sg->va),
+                  end - start) != end - start) {
+            iunlock(p->exe);
+            return -1;
         }
+
+        iunlock(p->exe);
     }
-    return d;
 
-bad: freevm(d);
+    return 0;
+}
+
+// Handle a fault at user address va of process p (by the user program
+// or by the kernel on behalf of it). For a write to a copy-on-write page,
+// give p its own copy. A page that is not present yet (program text and
+// data, or heap grown by sbrk) is zero-filled, and the parts of the
+// program segments covering it are read from the executable. Return 0
+// if the fault is resolved, -1 if p cannot access va.
+int faultuvm (struct proc *p, uint va, int write)
+{
+    pte_t *pte;
+    char *mem;
+    uint a;
+
+    if (va >= p->sz) {
+        return -1;
+    }
+
+    a = align_dn(va, PTE_SZ);
+    pte = walkpgdir(p->pgdir, (void*) a, 0);
+
+    if ((pte != 0) && (*pte & PE_TYPES)) {
+        if (PTE_COW(*pte)) {
+            if (!write) {
+                return 0;
+            }
+
+            p->nfault++;
+            return cowuvm(p->pgdir, a);
+        }
+
+        return (PTE_AP(*pte) == AP_KU) ? 0 : -1;
+    }
+
+    if ((mem = alloc_page()) == 0) {
+        return -1;
+    }
+
+    zero_page(mem);
+
+    if (loadseg(p, mem, a) < 0) {
+        free_page(mem);
+        return -1;
+    }
+
+    if (mappages(p->pgdir, (void*) a, PTE_SZ, v2p(mem), AP_KU) < 0) {
+        free_page(mem);
+        return -1;
+    }
+
+    p->nfault++;
+    sync_icache();
     return 0;
 }
 
@@ -387,7 +525,7 @@ char* uva2ka (pde_t *pgdir, char *uva)
     pte = walkpgdir(pgdir, uva, 0);
 
     // make sure it exists
-    if ((*pte & PE_TYPES) == 0) {
+    if ((pte == 0) || (*pte & PE_TYPES) == 0) {
         return 0;
     }
 
@@ -411,6 +549,9 @@ int copyout (pde_t *pgdir, uint va, void *p, uint len)
 
     while (len > 0) {
         va0 = align_dn(va, PTE_SZ);
+
+        // break copy-on-write before writing through the kernel map
+        cowuvm(pgdir, va0);
         pa0 = uva2ka(pgdir, (char*) va0);
 
         if (pa0 == 0) {